@@ -1,5 +1,7 @@
 #include "configuration.h"
 
+#include <cstring>
+
 Configuration::Configuration(double* PUser)
   : user_data(reinterpret_cast<char*>(PUser))
 {
@@ -18,13 +20,41 @@ Configuration::Configuration(double* PUser)
     includeInputNames = *read_pointer == 1;
     ++read_pointer;
     includeOutputNames = *read_pointer == 1;
+    ++read_pointer;
+    stagedRouting = *read_pointer == 1;
+    ++read_pointer;
+    presetFile = std::string(read_pointer);
+    read_pointer += presetFile.size() + 1;
+    optimisticTies = *read_pointer == 1;
+    ++read_pointer;
+    statisticsPins = *read_pointer == 1;
+    ++read_pointer;
+    traceFile = std::string(read_pointer);
+    read_pointer += traceFile.size() + 1;
+    unsigned int storedBaudRate;
+    memcpy(&storedBaudRate, read_pointer, sizeof(storedBaudRate));
+    read_pointer += sizeof(storedBaudRate);
+    // Configurations stored before the rate was configurable contain 0.
+    if (storedBaudRate != 0)
+      baudRate = storedBaudRate;
+    negotiateBaudRate = *read_pointer == 1;
+    ++read_pointer;
+    compactPins = *read_pointer == 1;
+    ++read_pointer;
+    mapPins = *read_pointer == 1;
+    ++read_pointer;
+    tallyPins = *read_pointer == 1;
+    ++read_pointer;
+    nameVerification = static_cast<unsigned char>(*read_pointer);
   }
 }
 
 bool Configuration::Write()
 {
-  size_t data_size =
-    1 + comPort.size() + 1 + sizeof(inputs) + sizeof(outputs) + 1 + 1;
+  size_t data_size = 1 + comPort.size() + 1 + sizeof(inputs) +
+                     sizeof(outputs) + 1 + 1 + 1 + presetFile.size() + 1 + 1 +
+                     1 + traceFile.size() + 1 + sizeof(baudRate) + 1 + 1 +
+                     1 + 1 + 1;
 
   if (data_size > max_size) {
     return false;
@@ -46,5 +76,27 @@ bool Configuration::Write()
   *write_pointer = includeInputNames ? 1 : 0;
   write_pointer += 1;
   *write_pointer = includeOutputNames ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = stagedRouting ? 1 : 0;
+  write_pointer += 1;
+  memcpy(write_pointer, presetFile.c_str(), presetFile.size());
+  write_pointer += presetFile.size() + 1;
+  *write_pointer = optimisticTies ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = statisticsPins ? 1 : 0;
+  write_pointer += 1;
+  memcpy(write_pointer, traceFile.c_str(), traceFile.size());
+  write_pointer += traceFile.size() + 1;
+  memcpy(write_pointer, reinterpret_cast<void*>(&baudRate), sizeof(baudRate));
+  write_pointer += sizeof(baudRate);
+  *write_pointer = negotiateBaudRate ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = compactPins ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = mapPins ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = tallyPins ? 1 : 0;
+  write_pointer += 1;
+  *write_pointer = static_cast<char>(nameVerification);
   return true;
 }
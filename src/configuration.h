@@ -13,12 +13,58 @@ struct Configuration
   unsigned int outputs{ 12 };
   bool includeInputNames{ false };
   bool includeOutputNames{ false };
+  bool stagedRouting{ false };
+  std::string presetFile;
+  bool optimisticTies{ false };
+  bool statisticsPins{ false };
+  std::string traceFile;
+  unsigned int baudRate{ 9600 };
+  bool negotiateBaudRate{ false };
+  bool compactPins{ false };
+  bool mapPins{ false };
+  bool tallyPins{ false };
+  //! Value of Device::NameVerification.
+  unsigned int nameVerification{ 0 };
+
+  //! ProfiLab counts the pins of a DLL in an unsigned char.
+  static constexpr unsigned int max_pins = 255;
+  //! Outputs packed into an OUT pin with compact pins. Each output takes three
+  //! decimal digits of the 15 a double holds exactly.
+  static constexpr unsigned int outputs_per_compact_pin = 5;
+  //! Number of pins added by statisticsPins.
+  static constexpr unsigned int statistics_pin_count = 6;
 
   Configuration() = default;
   explicit Configuration(double* PUser);
 
   bool Write();
 
+  //! Number of OUT pins on each side, or 1 for the $MAP pin.
+  unsigned int RoutingPins() const
+  {
+    if (mapPins)
+      return 1;
+    if (!compactPins)
+      return outputs;
+    return (outputs + outputs_per_compact_pin - 1) / outputs_per_compact_pin;
+  }
+
+  //! Number of input pins of the DLL.
+  unsigned int InputPins() const
+  {
+    return 2 + RoutingPins() + (includeInputNames ? 1 : 0) +
+           (includeOutputNames ? 1 : 0) + (stagedRouting ? 1 : 0);
+  }
+
+  //! Number of output pins of the DLL.
+  unsigned int OutputPins() const
+  {
+    return 3 + RoutingPins() + (includeInputNames ? 1 : 0) +
+           (includeOutputNames ? 1 : 0) + (optimisticTies ? 1 : 0) +
+           (statisticsPins ? statistics_pin_count : 0) +
+           (tallyPins ? inputs : 0);
+  }
+
 private:
   char* user_data;
   static const size_t max_size = sizeof(double) * 100;
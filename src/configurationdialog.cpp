@@ -1,9 +1,29 @@
 #include "configurationdialog.h"
 #include "resource.h"
 
+#include <algorithm>
 #include <commdlg.h>
+#include <cstdlib>
 
-#include "listserialports.h"
+#include "serialportdiscovery.h"
+
+namespace {
+//! Posted to the dialog when a discovery of the serial ports completed.
+const UINT WM_PORTS_DISCOVERED = WM_APP + 1;
+
+//! Separates the name of a port from the matrix found behind it.
+const char* const matrixSeparator = " - ";
+
+//! Kept while the DLL is loaded, so a dialog lists the ports found for the
+//! previous one right away. Each dialog waits for its discovery when it is
+//! destroyed, so no thread of the discovery outlives the dialog and the DLL
+//! can be unloaded at any time.
+SerialPortDiscovery& Discovery()
+{
+  static SerialPortDiscovery discovery;
+  return discovery;
+}
+} // namespace
 
 ConfigurationDialog::ConfigurationDialog(double* PUser)
   : got(false)
@@ -22,6 +42,72 @@ std::string GetInputText(HWND dlg, int resid)
   return s;
 }
 
+//! List the discovered ports, the ones with a matrix first, and keep the text
+//! of the port edit box.
+void FillPortList(HWND dlg)
+{
+  const std::string text = GetInputText(dlg, IDC_COMPORT);
+  SendDlgItemMessage(dlg, IDC_COMPORT, CB_RESETCONTENT, 0, 0);
+  for (const SerialPortDiscovery::Port& port : Discovery().GetPorts()) {
+    std::string entry = port.name;
+    if (port.matrix) {
+      entry += matrixSeparator + std::to_string(port.inputs) + "x" +
+               std::to_string(port.outputs) + " Extron matrix";
+    }
+    SendDlgItemMessage(
+      dlg, IDC_COMPORT, CB_ADDSTRING, 0, (LPARAM)(LPCTSTR)entry.c_str());
+  }
+  SetWindowText(GetDlgItem(dlg, IDC_COMPORT), text.c_str());
+}
+
+//! Discover the ports in the background and disable probing until the list
+//! was updated.
+void StartDiscovery(HWND dlg, bool probe, unsigned int baudRate)
+{
+  const bool started = Discovery().Start(probe, baudRate, [dlg]() {
+    PostMessage(dlg, WM_PORTS_DISCOVERED, 0, 0);
+  });
+  if (started)
+    EnableWindow(GetDlgItem(dlg, IDC_PROBEPORTS), FALSE);
+}
+
+//! Check that ProfiLab can show all pins and offer compact pins if they are
+//! too many.
+//! @return whether the configuration may be stored
+bool FitsPinBudget(HWND dlg, Configuration& configuration)
+{
+  auto fits = [&configuration]() {
+    return configuration.InputPins() <= Configuration::max_pins &&
+           configuration.OutputPins() <= Configuration::max_pins;
+  };
+  if (fits())
+    return true;
+
+  const std::string pins = std::to_string(Configuration::max_pins);
+  if (!configuration.compactPins) {
+    const std::string question =
+      "ProfiLab supports at most " + pins +
+      " pins per side. Pack five outputs into each OUT pin?";
+    if (MessageBox(dlg,
+                   question.c_str(),
+                   "Extron Matrix Configuration",
+                   MB_YESNO | MB_ICONQUESTION) != IDYES)
+      return false;
+
+    configuration.compactPins = true;
+    CheckDlgButton(dlg, IDC_COMPACTPINS, BST_CHECKED);
+    if (fits())
+      return true;
+  }
+
+  const std::string error =
+    "Even with compact pins the configuration needs more than " + pins +
+    " pins per side.";
+  MessageBox(
+    dlg, error.c_str(), "Extron Matrix Configuration", MB_OK | MB_ICONERROR);
+  return false;
+}
+
 BOOL CALLBACK DialogProc(HWND hwnd, UINT message, WPARAM wp, LPARAM lp)
 {
   static ConfigurationDialog* getter = 0;
@@ -34,27 +120,76 @@ BOOL CALLBACK DialogProc(HWND hwnd, UINT message, WPARAM wp, LPARAM lp)
                     std::to_string(getter->configuration.inputs).c_str());
       SetWindowText(GetDlgItem(hwnd, IDC_OUTPUTS),
                     std::to_string(getter->configuration.outputs).c_str());
+      SetWindowText(GetDlgItem(hwnd, IDC_PRESETFILE),
+                    getter->configuration.presetFile.c_str());
 
-      for (const std::string& port : listSerialPorts()) {
-        SendDlgItemMessage(
-          hwnd, IDC_COMPORT, CB_ADDSTRING, 0, (LPARAM)(LPCTSTR)port.c_str());
-      }
+      // Show the ports of the previous discovery while they are listed
+      // again. They are only probed on request, as probing writes to every
+      // port.
+      FillPortList(hwnd);
+      StartDiscovery(hwnd, false, getter->configuration.baudRate);
 
       CheckDlgButton(
         hwnd, IDC_INPUTNAMEPINS, getter->configuration.includeInputNames);
       CheckDlgButton(
         hwnd, IDC_OUTPUTNAMEPINS, getter->configuration.includeOutputNames);
+      CheckDlgButton(
+        hwnd, IDC_STAGEDROUTING, getter->configuration.stagedRouting);
+      CheckDlgButton(
+        hwnd, IDC_OPTIMISTICTIES, getter->configuration.optimisticTies);
+      CheckDlgButton(
+        hwnd, IDC_STATISTICSPINS, getter->configuration.statisticsPins);
+      SetWindowText(GetDlgItem(hwnd, IDC_TRACEFILE),
+                    getter->configuration.traceFile.c_str());
+
+      // Rates supported by the Extron matrices, others may be typed in.
+      for (const char* rate : { "9600", "19200", "38400", "115200" }) {
+        SendDlgItemMessage(
+          hwnd, IDC_BAUDRATE, CB_ADDSTRING, 0, (LPARAM)(LPCTSTR)rate);
+      }
+      SetWindowText(GetDlgItem(hwnd, IDC_BAUDRATE),
+                    std::to_string(getter->configuration.baudRate).c_str());
+      CheckDlgButton(hwnd,
+                     IDC_NEGOTIATEBAUDRATE,
+                     getter->configuration.negotiateBaudRate);
+      CheckDlgButton(
+        hwnd, IDC_COMPACTPINS, getter->configuration.compactPins);
+      CheckDlgButton(hwnd, IDC_MAPPINS, getter->configuration.mapPins);
+      CheckDlgButton(hwnd, IDC_TALLYPINS, getter->configuration.tallyPins);
+      // In the order of Device::NameVerification.
+      for (const char* verification :
+           { "Always", "Sampled", "Trust Acknowledgement" }) {
+        SendDlgItemMessage(hwnd,
+                           IDC_NAMEVERIFICATION,
+                           CB_ADDSTRING,
+                           0,
+                           (LPARAM)(LPCTSTR)verification);
+      }
+      SendDlgItemMessage(hwnd,
+                         IDC_NAMEVERIFICATION,
+                         CB_SETCURSEL,
+                         getter->configuration.nameVerification,
+                         0);
       return TRUE;
     }
     case WM_COMMAND: {
       int ctl = LOWORD(wp);
       int event = HIWORD(wp);
-      if (ctl == IDCANCEL && event == BN_CLICKED) {
+      if (ctl == IDC_PROBEPORTS && event == BN_CLICKED) {
+        // Probe with the rate the matrix is configured for.
+        const unsigned long baudRate =
+          strtoul(GetInputText(hwnd, IDC_BAUDRATE).c_str(), nullptr, 10);
+        StartDiscovery(
+          hwnd, true, baudRate != 0 ? baudRate : Configuration().baudRate);
+        return TRUE;
+      } else if (ctl == IDCANCEL && event == BN_CLICKED) {
         getter->got = false;
         DestroyWindow(hwnd);
         return TRUE;
       } else if (ctl == IDOK && event == BN_CLICKED) {
-        getter->configuration.comPort = GetInputText(hwnd, IDC_COMPORT);
+        const std::string port = GetInputText(hwnd, IDC_COMPORT);
+        getter->configuration.comPort =
+          port.substr(0, port.find(matrixSeparator));
 
         getter->configuration.inputs =
           std::stoi(GetInputText(hwnd, IDC_INPUTS));
@@ -67,6 +202,38 @@ BOOL CALLBACK DialogProc(HWND hwnd, UINT message, WPARAM wp, LPARAM lp)
         getter->configuration.includeOutputNames =
           SendDlgItemMessage(hwnd, IDC_OUTPUTNAMEPINS, BM_GETCHECK, 0, 0) ==
           BST_CHECKED;
+        getter->configuration.stagedRouting =
+          SendDlgItemMessage(hwnd, IDC_STAGEDROUTING, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.presetFile = GetInputText(hwnd, IDC_PRESETFILE);
+        getter->configuration.optimisticTies =
+          SendDlgItemMessage(hwnd, IDC_OPTIMISTICTIES, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.statisticsPins =
+          SendDlgItemMessage(hwnd, IDC_STATISTICSPINS, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.traceFile = GetInputText(hwnd, IDC_TRACEFILE);
+        getter->configuration.baudRate =
+          std::stoi(GetInputText(hwnd, IDC_BAUDRATE));
+        getter->configuration.negotiateBaudRate =
+          SendDlgItemMessage(hwnd, IDC_NEGOTIATEBAUDRATE, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.compactPins =
+          SendDlgItemMessage(hwnd, IDC_COMPACTPINS, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.mapPins =
+          SendDlgItemMessage(hwnd, IDC_MAPPINS, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.tallyPins =
+          SendDlgItemMessage(hwnd, IDC_TALLYPINS, BM_GETCHECK, 0, 0) ==
+          BST_CHECKED;
+        getter->configuration.nameVerification =
+          static_cast<unsigned int>(std::max<LRESULT>(
+            SendDlgItemMessage(hwnd, IDC_NAMEVERIFICATION, CB_GETCURSEL, 0, 0),
+            0));
+
+        if (!FitsPinBudget(hwnd, getter->configuration))
+          return TRUE;
 
         getter->got = true;
         DestroyWindow(hwnd);
@@ -74,7 +241,13 @@ BOOL CALLBACK DialogProc(HWND hwnd, UINT message, WPARAM wp, LPARAM lp)
       }
       return FALSE;
     }
+    case WM_PORTS_DISCOVERED:
+      FillPortList(hwnd);
+      EnableWindow(GetDlgItem(hwnd, IDC_PROBEPORTS), TRUE);
+      return TRUE;
     case WM_DESTROY:
+      // Probes take up to SerialPortDiscovery::probe_timeout.
+      Discovery().Wait();
       PostQuitMessage(0);
       return TRUE;
     case WM_CLOSE:
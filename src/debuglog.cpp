@@ -0,0 +1,16 @@
+#include "debuglog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <iostream>
+#endif
+
+void DebugLog(const std::string& message)
+{
+#ifdef _WIN32
+  OutputDebugStringA(message.c_str());
+#else
+  std::clog << message << std::endl;
+#endif
+}
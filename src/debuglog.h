@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+//! Write a message for developers to the debugger on Windows or to stderr on
+//! other platforms.
+void DebugLog(const std::string& message);
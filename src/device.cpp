@@ -1,5 +1,6 @@
 #include "device.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <regex>
 #include <sstream>
@@ -8,93 +9,363 @@
 #include <boost/format.hpp>
 #include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
-#include <regex>
-#include <sstream>
+
+#include "debuglog.h"
+#include "serialtrace.h"
+#include "tiecost.h"
 
 namespace {
 
 namespace ResponsePatterns {
   const std::regex error("^E([0-9]{2})$");
-  const std::regex tie("^Out([0-9]{2}) In([0-9]{2}) All$");
+  const std::regex tie("^Out([0-9]{2,3}) In([0-9]{2,3}) All$");
   // Documentation lies! U is followed by only one digit
   const std::regex request_information(
-    "^I([0-9]{2})X([0-9]{2}) T([0-9]) U([0-9]{1}) M([0-9]{2})X([0-9]{2}) "
-    "Vmt([0-9]) Amt([0-9]) Sys([0-9]) Dgn([0-9]{2})$");
-  const std::regex current_configuration("^([0-9]{2} ){16}All$");
+    "^I([0-9]{2,3})X([0-9]{2,3}) T([0-9]) U([0-9]{1}) "
+    "M([0-9]{2,3})X([0-9]{2,3}) Vmt([0-9]) Amt([0-9]) Sys([0-9]) "
+    "Dgn([0-9]{2})$");
+  // Frames with more than 99 inputs use three digits.
+  const std::regex current_configuration("^([0-9]{2,3} ){16}All$");
   const std::regex reconfig("^RECONFIG([0-9]{2})$");
+  const std::regex multi_tie("^Qik$");
+  const std::regex tie_all("^In([0-9]{2,3}) All$");
+  const std::regex store("^Spr([0-9]{2})$");
+  const std::regex recall("^Rpr([0-9]{2})$");
+  const std::regex baud_rate("^Cpn1 Ccp([0-9]+),n,8,1$");
 }
 
+//! Unsolicited RECONFIG messages of the device.
+namespace Notifications {
+  //! The ties changed.
+  const unsigned int connections_changed = 14;
+
+  //! Consecutive ids which each announce that the names of the next block of
+  //! channels changed, starting with channel 1.
+  struct NameBlocks
+  {
+    unsigned int first_id;
+    unsigned int last_id;
+    bool inputs;
+  };
+
+  //! Number of channels whose names one id covers.
+  const unsigned int block_size = 16;
+
+  const std::array<NameBlocks, 2> name_blocks{ {
+    { 17, 20, true },
+    { 21, 24, false },
+  } };
+}
+
+namespace Parsing {
+  //! Call f(input, output) for every "in*out!" contained in a request.
+  template<typename F>
+  void for_each_tie(const RequestBuffer& request, F f)
+  {
+    static const std::regex tie("([0-9]+)\\*([0-9]+)!");
+    for (std::cregex_iterator it(
+           request.data(), request.data() + request.size(), tie),
+         end;
+         it != end;
+         ++it) {
+      f(boost::lexical_cast<unsigned int>(it->str(1)),
+        boost::lexical_cast<unsigned int>(it->str(2)));
+    }
+  }
+}
+
+//! Time to wait for the response to a request before giving up on it.
+const std::chrono::milliseconds response_timeout(1000);
+//! Interval in which the response deadline is checked.
+const std::chrono::milliseconds response_check_interval(100);
+//! Time between two reads of the audit of names written without verification.
+const std::chrono::milliseconds name_audit_interval(1000);
+
 namespace Commands {
   const Device::Request request_information{
     Device::RequestType::RequestInformation,
     "I"
   };
+  const Device::Request probe_baud_rate{ Device::RequestType::ProbeBaudRate,
+                                         "I" };
 }
 }
 
+const std::array<unsigned int, 4> Device::baud_rates{
+  { 9600, 19200, 38400, 115200 }
+};
+
 Device::Device(boost::asio::io_service& io_service)
-  : number_of_presets(32)
+  : model(nullptr)
+  , number_of_presets(0)
   , number_of_virtual_inputs(0)
   , number_of_virtual_outputs(0)
+  , next_preset_to_cache(1)
+  , verifying_preset(0)
   , port(io_service)
   , buffer(2)
+  , response_timer(io_service)
   , request_in_progress({ RequestType::None, "" })
   , viewed_current_outputs(0)
 {}
 
-uint8_t Device::get_number_of_virtual_inputs() const
+uint16_t Device::get_number_of_virtual_inputs() const
 {
   return number_of_virtual_inputs;
 }
 
-uint8_t Device::get_number_of_virtual_outputs() const
+uint16_t Device::get_number_of_virtual_outputs() const
 {
   return number_of_virtual_outputs;
 }
 
+const DeviceStatistics& Device::get_statistics() const
+{
+  return statistics;
+}
+
+const Device::OutputSet& Device::get_outputs_of_input(uint16_t input) const
+{
+  static const OutputSet none;
+  if (input >= outputs_of_input.size())
+    return none;
+  return outputs_of_input[input];
+}
+
+uint16_t Device::count_outputs_of_input(uint16_t input) const
+{
+  return static_cast<uint16_t>(get_outputs_of_input(input).count());
+}
+
+void Device::set_current_input(uint16_t output, uint16_t input)
+{
+  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+  uint16_t& current = current_input_of_output[output - 1];
+  if (current < outputs_of_input.size())
+    outputs_of_input[current].reset(output - 1);
+  current = input;
+  if (input < outputs_of_input.size())
+    outputs_of_input[input].set(output - 1);
+}
+
+unsigned int Device::get_baud_rate() const
+{
+  return baud_rate;
+}
+
 void Device::tie(unsigned int input, unsigned int output)
 {
-  std::stringstream str;
-  str << input << "*" << output << "!";
-  const bool value_change = current_input_of_output[output] != input;
-  add_to_queue({ RequestType::Tie, str.str() },
-               value_change ? QueueType::HighPriority : QueueType::LowPriority);
+  RequestBuffer str;
+  str << input << '*' << output << '!';
+
+  bool in_range;
+  bool value_change;
+  {
+    // The io service changes the routing while processing responses.
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+    // Input 0 unties the output.
+    in_range = input <= number_of_virtual_inputs && output >= 1 &&
+               output <= number_of_virtual_outputs;
+    value_change = in_range && current_input_of_output[output - 1] != input;
+  }
+  if (!in_range) {
+    reject_request(
+      { RequestType::Tie, str, static_cast<uint16_t>(output) },
+      (boost::format("Tie %1% is out of range.") % str.str()).str());
+    return;
+  }
+
+  add_to_queue({ RequestType::Tie, str, static_cast<uint16_t>(output) },
+               value_change ? RequestClass::Control
+                            : RequestClass::Monitoring);
+}
+
+void Device::tie_multiple(const std::vector<unsigned int>& input_of_output)
+{
+  uint16_t inputs;
+  {
+    // The io service changes the routing while processing responses, so the
+    // ties are diffed against a copy.
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+    if (model == nullptr)
+      return;
+    inputs = number_of_virtual_inputs;
+    routing_snapshot = current_input_of_output;
+  }
+
+  // A whole scene from one input is a single "in*!".
+  const std::optional<unsigned int> broadcast =
+    TieCost::broadcast_input(input_of_output, routing_snapshot);
+  if (broadcast && *broadcast <= inputs) {
+    RequestBuffer str;
+    str << *broadcast << "*!";
+    add_to_queue(
+      { RequestType::TieAll, str, static_cast<uint16_t>(*broadcast) },
+      RequestClass::Control);
+    return;
+  }
+
+  const RequestBuffer start("\x1B+Q");
+  RequestBuffer str;
+  for (size_t i = 0;
+       i < input_of_output.size() && i < routing_snapshot.size();
+       ++i) {
+    if (routing_snapshot[i] == input_of_output[i])
+      continue;
+
+    RequestBuffer tie;
+    tie << input_of_output[i] << '*' << static_cast<unsigned int>(i + 1)
+        << '!';
+    if (input_of_output[i] > inputs) {
+      reject_request(
+        { RequestType::Tie, tie, static_cast<uint16_t>(i + 1) },
+        (boost::format("Tie %1% is out of range.") % tie.str()).str());
+      continue;
+    }
+    // Keep room for the terminating \r.
+    if (str.size() + tie.size() + 1 > RequestBuffer::capacity) {
+      str << '\r';
+      add_to_queue({ RequestType::MultiTie, str }, RequestClass::Control);
+      str = RequestBuffer();
+    }
+    if (str.empty())
+      str << start;
+    str << tie;
+  }
+
+  if (!str.empty()) {
+    str << '\r';
+    add_to_queue({ RequestType::MultiTie, str }, RequestClass::Control);
+  }
 }
 
 void Device::store(unsigned int index)
 {
-  std::stringstream str;
-  str << index << ",";
-  clear_queue(QueueType::HighPriority);
-  clear_queue(QueueType::LowPriority);
-  add_to_queue({ RequestType::Store, str.str() }, QueueType::HighPriority);
+  RequestBuffer str;
+  str << index << ',';
+  if (index < 1 || index > number_of_presets) {
+    reject_request(
+      { RequestType::Store, str, static_cast<uint16_t>(index) },
+      (boost::format("Preset %1% is out of range.") % index).str());
+    return;
+  }
+
+  clear_queues();
+  add_to_queue({ RequestType::Store, str, static_cast<uint16_t>(index) },
+               RequestClass::Control);
 }
 
 void Device::recall(unsigned int index)
 {
-  std::stringstream str;
-  str << index << ".";
-  clear_queue(QueueType::HighPriority);
-  clear_queue(QueueType::LowPriority);
-  add_to_queue({ RequestType::Recall, str.str() }, QueueType::HighPriority);
+  RequestBuffer str;
+  str << index << '.';
+  if (index < 1 || index > number_of_presets) {
+    reject_request(
+      { RequestType::Recall, str },
+      (boost::format("Preset %1% is out of range.") % index).str());
+    return;
+  }
+
+  clear_queues();
+  add_to_queue({ RequestType::Recall, str, static_cast<uint16_t>(index) },
+               RequestClass::Control);
+
+  // Publish the cached result right away. The actual routing is read once the
+  // matrix answered the recall, to correct the cache if it drifted. Queued
+  // now, the scheduler might send the reads before the recall.
+  boost::asio::post(port.get_executor(),
+                    [this, index]() { apply_cached_preset(index); });
+}
+
+void Device::apply_cached_preset(unsigned int index)
+{
+  if (index < 1 || index > preset_ties.size())
+    return;
+
+  verifying_preset = index;
+
+  if (!preset_cached[index - 1])
+    return;
+
+  const std::vector<uint16_t>& ties = preset_ties[index - 1];
+  for (size_t i = 0; i < ties.size() && i < current_input_of_output.size();
+       ++i) {
+    if (current_input_of_output[i] != ties[i]) {
+      set_current_input(static_cast<uint16_t>(i + 1), ties[i]);
+      tieChanged(static_cast<uint16_t>(i + 1), ties[i]);
+    }
+  }
+}
+
+void Device::set_input_name(uint16_t index, const std::string& name)
+{
+  RequestBuffer str;
+  str << "\x1BnI" << static_cast<unsigned int>(index) << ',';
+  if (index < 1 || index > number_of_virtual_inputs) {
+    reject_request(
+      { RequestType::WriteVirtualInputName, str, index },
+      (boost::format("Input %1% is out of range.") % unsigned(index)).str());
+    return;
+  }
+
+  const size_t length =
+    std::min({ name.size(), ExtronModels::name_length, str.available() - 1 });
+  str.append(name.data(), length) << '\r';
+  const bool value_change =
+    name.compare(0, length, input_names[index - 1]) != 0;
+  add_to_queue({ RequestType::WriteVirtualInputName, str, index },
+               value_change ? RequestClass::Control
+                            : RequestClass::Monitoring);
+}
+
+void Device::set_output_name(uint16_t index, const std::string& name)
+{
+  RequestBuffer str;
+  str << "\x1BnO" << static_cast<unsigned int>(index) << ',';
+  if (index < 1 || index > number_of_virtual_outputs) {
+    reject_request(
+      { RequestType::WriteVirtualOutputName, str, index },
+      (boost::format("Output %1% is out of range.") % unsigned(index)).str());
+    return;
+  }
+
+  const size_t length =
+    std::min({ name.size(), ExtronModels::name_length, str.available() - 1 });
+  str.append(name.data(), length) << '\r';
+  const bool value_change =
+    name.compare(0, length, output_names[index - 1]) != 0;
+  add_to_queue({ RequestType::WriteVirtualOutputName, str, index },
+               value_change ? RequestClass::Control
+                            : RequestClass::Monitoring);
+}
+
+void Device::set_synchronized_names(uint16_t inputs, uint16_t outputs)
+{
+  synchronized_input_names = inputs;
+  synchronized_output_names = outputs;
 }
 
-void Device::set_input_name(uint8_t index, const std::string& name)
+void Device::request_synchronized_names()
 {
-  std::stringstream str;
-  str << "\x1BnI" << static_cast<unsigned int>(index) << "," << name << "\r";
-  const bool value_change = input_names[index] != name;
-  add_to_queue({ RequestType::WriteVirtualInputName, str.str(), index },
-               value_change ? QueueType::HighPriority : QueueType::LowPriority);
+  for (uint16_t output = 1; output <= number_of_virtual_outputs &&
+                            output <= synchronized_output_names;
+       ++output) {
+    request_virtual_output_name(output);
+  }
+
+  for (uint16_t input = 1;
+       input <= number_of_virtual_inputs && input <= synchronized_input_names;
+       ++input) {
+    request_virtual_input_name(input);
+  }
 }
 
-void Device::set_output_name(uint8_t index, const std::string& name)
+void Device::set_name_verification(NameVerification verification)
 {
-  std::stringstream str;
-  str << "\x1BnO" << static_cast<unsigned int>(index) << "," << name << "\r";
-  const bool value_change = output_names[index] != name;
-  add_to_queue({ RequestType::WriteVirtualOutputName, str.str(), index },
-               value_change ? QueueType::HighPriority : QueueType::LowPriority);
+  name_verification = verification;
 }
 
 void Device::request_begin_current_configuration_requests()
@@ -102,54 +373,271 @@ void Device::request_begin_current_configuration_requests()
   // Queue type must be the same as for the following request_* methods because
   // this one must immediately preceed them.
   add_to_queue({ RequestType::BeginRequestCurrentConfiguration, "" },
-               QueueType::LowPriority);
+               RequestClass::Monitoring);
+}
+
+void Device::request_current_routing()
+{
+  request_begin_current_configuration_requests();
+  for (unsigned int start_output = 1; start_output <= number_of_virtual_outputs;
+       start_output += 16) {
+    request_current_configuration(start_output);
+  }
 }
 
 void Device::request_current_configuration(unsigned int start_output)
 {
-  std::stringstream str;
+  RequestBuffer str;
   str << "0*" << start_output << "*00VA";
-  add_to_queue({ RequestType::RequestCurrentConfiguration, str.str() },
-               QueueType::LowPriority);
+  add_to_queue({ RequestType::RequestCurrentConfiguration, str },
+               RequestClass::Monitoring);
+}
+
+bool Device::request_next_uncached_preset()
+{
+  if (number_of_virtual_outputs == 0)
+    return false;
+
+  while (next_preset_to_cache <= number_of_presets &&
+         preset_cached[next_preset_to_cache - 1]) {
+    ++next_preset_to_cache;
+  }
+  if (next_preset_to_cache > number_of_presets)
+    return false;
+
+  const uint16_t preset = static_cast<uint16_t>(next_preset_to_cache++);
+  for (unsigned int start_output = 1; start_output <= number_of_virtual_outputs;
+       start_output += 16) {
+    RequestBuffer str;
+    str << static_cast<unsigned int>(preset) << '*' << start_output << "*00VA";
+    Request request{ RequestType::RequestPresetConfiguration,
+                     str,
+                     preset,
+                     static_cast<uint16_t>(start_output) };
+    enqueued(request);
+    request_queue.push(
+      RequestClass::Monitoring, request, SteadyClock::now());
+  }
+
+  request_queue.pop(request_in_progress, SteadyClock::now());
+  update_queue_depths();
+  write_request_in_progress();
+  return true;
+}
+
+void Device::request_virtual_output_name(uint16_t output)
+{
+  // The matrix would answer with an error.
+  if (output > number_of_virtual_outputs)
+    return;
+  if (!queue_name_read(number_of_virtual_inputs + output - 1u))
+    return;
+
+  RequestBuffer str;
+  str << "\x1BNO" << static_cast<unsigned int>(output) << '\r';
+  add_to_queue({ RequestType::ReadVirtualOutputName, str, output },
+               RequestClass::Names);
+}
+
+void Device::request_virtual_input_name(uint16_t input)
+{
+  // The matrix would answer with an error.
+  if (input > number_of_virtual_inputs)
+    return;
+  if (!queue_name_read(input - 1u))
+    return;
+
+  RequestBuffer str;
+  str << "\x1BNI" << static_cast<unsigned int>(input) << '\r';
+  add_to_queue({ RequestType::ReadVirtualInputName, str, input },
+               RequestClass::Names);
+}
+
+void Device::written_name_acknowledged(bool inputs)
+{
+  const uint16_t index = request_in_progress.index;
+  const size_t channel =
+    inputs ? index - 1u : number_of_virtual_inputs + index - 1u;
+  const bool verify =
+    name_verification == NameVerification::Always ||
+    (name_verification == NameVerification::Sampled &&
+     acknowledged_names++ % name_verification_sample == 0);
+  if (verify || channel >= unverified_names.size()) {
+    if (inputs)
+      request_virtual_input_name(index);
+    else
+      request_virtual_output_name(index);
+    return;
+  }
+
+  // The name follows the comma up to the terminating \r.
+  const RequestBuffer& request = request_in_progress.request;
+  const char* begin = static_cast<const char*>(
+                        memchr(request.data(), ',', request.size())) +
+                      1;
+  const char* end = request.data() + request.size() - 1;
+  std::string& name = inputs ? input_names[index - 1] : output_names[index - 1];
+  name.assign(begin, end);
+  if (inputs)
+    inputNameChanged(index, name);
+  else
+    outputNameChanged(index, name);
+
+  if (unverified_names[channel])
+    return;
+  // Give a relabel time to finish before auditing it.
+  if (unverified_name_count == 0)
+    next_name_audit = SteadyClock::now() + name_audit_interval;
+  unverified_names[channel] = true;
+  ++unverified_name_count;
+}
+
+void Device::name_verified(size_t channel)
+{
+  if (channel < unverified_names.size() && unverified_names[channel]) {
+    unverified_names[channel] = false;
+    --unverified_name_count;
+  }
 }
 
-void Device::request_virtual_output_name(uint8_t output)
+bool Device::request_next_name_audit()
 {
-  std::stringstream str;
-  str << "\x1BNO" << static_cast<unsigned int>(output) << "\r";
-  add_to_queue({ RequestType::ReadVirtualOutputName, str.str(), output },
-               QueueType::LowPriority);
+  if (unverified_name_count == 0 || SteadyClock::now() < next_name_audit)
+    return false;
+
+  while (!unverified_names[next_name_to_audit])
+    next_name_to_audit = (next_name_to_audit + 1) % unverified_names.size();
+
+  const size_t channel = next_name_to_audit;
+  next_name_to_audit = (next_name_to_audit + 1) % unverified_names.size();
+  next_name_audit = SteadyClock::now() + name_audit_interval;
+
+  const bool input = channel < number_of_virtual_inputs;
+  const uint16_t index = static_cast<uint16_t>(
+    input ? channel + 1 : channel - number_of_virtual_inputs + 1);
+  RequestBuffer str;
+  str << (input ? "\x1BNI" : "\x1BNO") << static_cast<unsigned int>(index)
+      << '\r';
+  request_in_progress = { input ? RequestType::ReadVirtualInputName
+                                : RequestType::ReadVirtualOutputName,
+                          str,
+                          index };
+  enqueued(request_in_progress);
+  write_request_in_progress();
+  return true;
 }
 
-void Device::request_virtual_input_name(uint8_t input)
+bool Device::queue_name_read(size_t channel)
 {
-  std::stringstream str;
-  str << "\x1BNI" << static_cast<unsigned int>(input) << "\r";
-  add_to_queue({ RequestType::ReadVirtualInputName, str.str(), input },
-               QueueType::LowPriority);
+  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+  if (channel >= queued_name_reads.size())
+    return true;
+  if (queued_name_reads[channel])
+    return false;
+  queued_name_reads[channel] = true;
+  return true;
 }
 
-void Device::open(const std::string& port_name)
+void Device::name_read_dequeued(const Request& request)
 {
-  port.open(port_name);
+  size_t channel;
+  if (request.type == RequestType::ReadVirtualInputName)
+    channel = request.index - 1u;
+  else if (request.type == RequestType::ReadVirtualOutputName)
+    channel = number_of_virtual_inputs + request.index - 1u;
+  else
+    return;
+
+  // Reads of names which the matrix may have changed again meanwhile are
+  // queued once more.
+  if (channel < queued_name_reads.size())
+    queued_name_reads[channel] = false;
+}
 
-  port.set_option(boost::asio::serial_port_base::baud_rate(9600));
-  port.set_option(boost::asio::serial_port_base::character_size(8));
-  port.set_option(boost::asio::serial_port_base::stop_bits(
-    boost::asio::serial_port_base::stop_bits::one));
-  port.set_option(boost::asio::serial_port_base::parity(
-    boost::asio::serial_port_base::parity::none));
-  port.set_option(boost::asio::serial_port_base::flow_control(
-    boost::asio::serial_port_base::flow_control::none));
+void Device::probe_baud_rate()
+{
+  add_to_queue(Commands::probe_baud_rate, RequestClass::Control);
+}
+
+void Device::upgrade_baud_rate()
+{
+  for (size_t i = baud_rates.size(); i-- > 0 && baud_rates[i] > baud_rate;) {
+    if (rejected_baud_rates & (1u << i))
+      continue;
+
+    // Set the RS-232 port of the device to the rate, no parity, 8 data bits
+    // and 1 stop bit. The device acknowledges with the old rate.
+    RequestBuffer str;
+    str << '\x1B' << "1*" << baud_rates[i] << ",n,8,1CP\r";
+    add_to_queue({ RequestType::SetBaudRate, str, static_cast<uint16_t>(i) },
+                 RequestClass::Control);
+    return;
+  }
+
+  DebugLog(
+    (boost::format("Communicating with %1% baud.") % baud_rate.load()).str());
+  add_to_queue(Commands::request_information, RequestClass::Monitoring);
+}
+
+void Device::probe_failed()
+{
+  if (verifying_baud_rate) {
+    // The device did not answer at the rate it was switched to, so it either
+    // ignored the switch or the connection does not carry the rate.
+    for (size_t i = 0; i < baud_rates.size(); ++i) {
+      if (baud_rates[i] == baud_rate)
+        rejected_baud_rates |= 1u << i;
+    }
+    verifying_baud_rate = false;
+  }
+
+  if (++unanswered_probes > baud_rates.size()) {
+    reportError("The device does not answer at any baud rate.");
+    return;
+  }
+
+  // Search for the rate of the device, starting after the current one.
+  const auto current =
+    std::find(baud_rates.begin(), baud_rates.end(), baud_rate);
+  const auto next = current == baud_rates.end() ||
+                        std::next(current) == baud_rates.end()
+                      ? baud_rates.begin()
+                      : std::next(current);
+  baud_rate = *next;
+  port.set_baud_rate(baud_rate);
+  probe_baud_rate();
+}
+
+void Device::open(const std::string& port_name,
+                  unsigned int baud_rate,
+                  bool negotiate_baud_rate)
+{
+  this->baud_rate = baud_rate;
+  this->negotiate_baud_rate = negotiate_baud_rate;
+  verifying_baud_rate = false;
+  unanswered_probes = 0;
+  rejected_baud_rates = 0;
+
+  port.open(port_name, baud_rate);
 
   initialize();
 }
 
 void Device::close()
 {
+  {
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+    response_timer.cancel();
+  }
   port.close();
 }
 
+void Device::set_trace(SerialTrace* trace)
+{
+  this->trace = trace;
+}
+
 void Device::initialize()
 {
   // Start reading from the serial port.
@@ -158,112 +646,217 @@ void Device::initialize()
     boost::bind(
       boost::mem_fn(&Device::read_handler), boost::ref(*this), _1, _2));
 
-  add_to_queue(Commands::request_information, QueueType::LowPriority);
+  {
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+    start_response_timer();
+  }
+
+  if (negotiate_baud_rate)
+    probe_baud_rate();
+  else
+    add_to_queue(Commands::request_information, RequestClass::Monitoring);
 }
 
-void Device::add_to_queue(Request command, QueueType queueType)
+void Device::add_to_queue(Request command, RequestClass request_class)
 {
-  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+  // A name is cut off to the length the matrix keeps anyway, but any other
+  // request cut off by its buffer would not do what was asked for.
+  if (command.request.truncated() &&
+      command.type != RequestType::WriteVirtualInputName &&
+      command.type != RequestType::WriteVirtualOutputName) {
+    reject_request(command,
+                   (boost::format("Request %1% is too long.") %
+                    command.request.str())
+                     .str());
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+    enqueued(command);
 
-  if (request_in_progress.type == RequestType::None) {
-    request_in_progress = command;
-    port.write_some(boost::asio::buffer(command.request));
-  } else if (queueType == QueueType::HighPriority) {
-    high_priority_request_queue.push_back(std::move(command));
-  } else if (queueType == QueueType::LowPriority) {
-    low_priority_request_queue.push_back(std::move(command));
+    if (request_in_progress.type == RequestType::None) {
+      request_in_progress = std::move(command);
+      write_request_in_progress();
+      return;
+    }
+
+    if (request_queue.push(
+          request_class, command, SteadyClock::now())) {
+      update_queue_depths();
+      return;
+    }
+    name_read_dequeued(command);
   }
+
+  statistics.count_dropped();
+  if (trace) {
+    static const char reason[] = "dropped";
+    trace->record(SerialTrace::Kind::Completed,
+                  static_cast<uint8_t>(command.type),
+                  command.number,
+                  reason,
+                  sizeof(reason) - 1,
+                  SerialTrace::Clock::now());
+  }
+
+  // The device does not keep up. Drop the new request instead of an older one
+  // whose outcome is already awaited.
+  reject_request(command,
+                 (boost::format("Request queue is full, dropped request %1%.") %
+                  command.request.str())
+                   .str());
 }
 
-void Device::clear_queue(QueueType queueType)
+void Device::reject_request(const Request& request, const std::string& error)
 {
+  boost::asio::post(port.get_executor(), [this, request, error]() {
+    reportError(error);
+    fail_request(request);
+  });
+}
+
+void Device::enqueued(Request& request)
+{
+  request.number = next_request_number++;
+
+  // The marker between the reads of the current configuration is not sent.
+  if (trace && !request.request.empty())
+    trace->record(SerialTrace::Kind::Enqueued,
+                  static_cast<uint8_t>(request.type),
+                  request.number,
+                  request.request.data(),
+                  request.request.size(),
+                  SerialTrace::Clock::now());
+}
+
+void Device::reserve_request_queues()
+{
+  const size_t inputs = number_of_virtual_inputs;
+  const size_t outputs = number_of_virtual_outputs;
+  // Number of requests to read the ties of all outputs.
+  const size_t tie_blocks = (outputs + 15) / 16;
+
   std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
 
-  switch (queueType) {
-    case QueueType::HighPriority:
-      high_priority_request_queue.clear();
-      break;
-    case QueueType::LowPriority:
-      low_priority_request_queue.clear();
-      break;
+  // A tie, a quick multiple tie and a name per output, a name per input, a
+  // store and a recall.
+  request_queue.set_capacity(RequestClass::Control, 3 * outputs + inputs + 2);
+  // A repeated tie per output, the information and reading the current ties
+  // for the connection and for a recall as well as the ties of a preset, each
+  // with its leading marker.
+  request_queue.set_capacity(RequestClass::Monitoring,
+                             outputs + 1 + 3 * (tie_blocks + 1));
+  // Every name is queued at most once.
+  request_queue.set_capacity(RequestClass::Names, inputs + outputs);
+  queued_name_reads.assign(inputs + outputs, false);
+}
+
+void Device::clear_queues()
+{
+  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+  // The dropped ties are never answered, so fail them like rejected ones.
+  // Their outputs would otherwise wait for them forever.
+  Request dropped;
+  while (request_queue.pop(dropped, SteadyClock::now())) {
+    if (dropped.type == RequestType::Tie ||
+        dropped.type == RequestType::MultiTie ||
+        dropped.type == RequestType::TieAll) {
+      boost::asio::post(port.get_executor(),
+                        [this, dropped]() { fail_request(dropped); });
+    }
+  }
+  request_queue.clear();
+  update_queue_depths();
+  std::fill(queued_name_reads.begin(), queued_name_reads.end(), false);
+  // Reads of presets might have been dropped.
+  next_preset_to_cache = 1;
+}
+
+void Device::update_queue_depths()
+{
+  for (RequestClass request_class : { RequestClass::Control,
+                                      RequestClass::Monitoring,
+                                      RequestClass::Names }) {
+    statistics.set_queue_depth(static_cast<size_t>(request_class),
+                               request_queue.size(request_class));
   }
 }
 
+void Device::count_response()
+{
+  if (request_in_progress.type == RequestType::None)
+    return;
+
+  const auto now = SteadyClock::now();
+  statistics.count_response(now - request_sent_at);
+  if (trace)
+    trace->record(SerialTrace::Kind::Completed,
+                  static_cast<uint8_t>(request_in_progress.type),
+                  request_in_progress.number,
+                  nullptr,
+                  0,
+                  now);
+}
+
 void Device::process_response(const std::string& response)
 {
   std::smatch m;
   std::regex_match(response, m, ResponsePatterns::error);
   if (!m.empty()) {
+    count_response();
+    statistics.count_error();
     std::string error_message =
       (boost::format("Received %1% in response to %2%.") % response %
-       request_in_progress.request)
+       request_in_progress.request.str())
         .str()
         .c_str();
-    reportError(error_message);
+    // A rate the device does not support only ends the negotiation.
+    if (request_in_progress.type == RequestType::SetBaudRate)
+      DebugLog(error_message);
+    else
+      reportError(error_message);
+    fail_request(request_in_progress);
   } else {
     {
       std::smatch m;
       std::regex_match(response, m, ResponsePatterns::reconfig);
       if (!m.empty()) {
-        unsigned int reconfig_id = boost::lexical_cast<unsigned int>(m.str(1));
-        switch (reconfig_id) {
-          case 14:
-            // Connections changed
-            add_to_queue(Commands::request_information, QueueType::LowPriority);
-            break;
-          case 17:
-            // Name change for virtual input #1-16
-            for (uint8_t input = 1; input <= 16; ++input) {
-              request_virtual_input_name(input);
-            }
-            break;
-          case 18:
-            // Name change for virtual input #17-32
-            for (uint8_t input = 17; input <= 32; ++input) {
-              request_virtual_input_name(input);
-            }
-            break;
-          case 19:
-            // Name change for virtual input #33-48
-            for (uint8_t input = 33; input <= 48; ++input) {
-              request_virtual_input_name(input);
-            }
-            break;
-          case 20:
-            // Name change for virtual input #49-64
-            for (uint8_t input = 49; input <= 64; ++input) {
-              request_virtual_input_name(input);
-            }
-            break;
-          case 21:
-            // Name change for virtual output #1-16
-            for (uint8_t output = 1; output <= 16; ++output) {
-              request_virtual_output_name(output);
-            }
-            break;
-          case 22:
-            // Name change for virtual output #17-32
-            for (uint8_t output = 17; output <= 32; ++output) {
-              request_virtual_output_name(output);
-            }
-            break;
-          case 23:
-            // Name change for virtual output #33-48
-            for (uint8_t output = 33; output <= 48; ++output) {
-              request_virtual_output_name(output);
-            }
-            break;
-          case 24:
-            // Name change for virtual output #49-64
-            for (uint8_t output = 49; output <= 64; ++output) {
-              request_virtual_output_name(output);
-            }
-            break;
+        const unsigned int reconfig_id =
+          boost::lexical_cast<unsigned int>(m.str(1));
+        if (reconfig_id == Notifications::connections_changed) {
+          add_to_queue(Commands::request_information,
+                       RequestClass::Monitoring);
+        }
+        for (const Notifications::NameBlocks& blocks :
+             Notifications::name_blocks) {
+          if (reconfig_id < blocks.first_id || reconfig_id > blocks.last_id)
+            continue;
+
+          const unsigned int first =
+            (reconfig_id - blocks.first_id) * Notifications::block_size + 1;
+          // Names nobody shows are not read.
+          const unsigned int synchronized = blocks.inputs
+                                              ? synchronized_input_names
+                                              : synchronized_output_names;
+          for (unsigned int channel = first;
+               channel < first + Notifications::block_size &&
+               channel <= synchronized;
+               ++channel) {
+            if (blocks.inputs)
+              request_virtual_input_name(static_cast<uint16_t>(channel));
+            else
+              request_virtual_output_name(static_cast<uint16_t>(channel));
+          }
         }
         return;
       }
     }
 
+    count_response();
+
     switch (request_in_progress.type) {
       case RequestType::RequestInformation: {
         std::smatch m;
@@ -336,32 +929,61 @@ void Device::process_response(const std::string& response)
                  << "  "
                  << "Diagnostics code: " << diagnostics;
 
-            OutputDebugString(strm.str().c_str());
-          }
-
-          number_of_virtual_inputs = in_map_size;
-          number_of_virtual_outputs = out_map_size;
-          current_input_of_output.resize(number_of_virtual_outputs, 0);
-          input_names.resize(number_of_virtual_inputs, "");
-          output_names.resize(number_of_virtual_outputs, "");
-          std::call_once(setupCallbackOnceFlag, setupCallback);
-
-          request_begin_current_configuration_requests();
-          for (unsigned int start_output = 1;
-               start_output <= number_of_virtual_outputs;
-               start_output += 16) {
-            request_current_configuration(start_output);
+            DebugLog(strm.str());
           }
 
-          for (uint8_t output = 1; output <= number_of_virtual_outputs;
-               ++output) {
-            request_virtual_output_name(output);
+          const ExtronModel* const found =
+            ExtronModels::find(in_map_size, out_map_size);
+          if (!found) {
+            reportError(
+              (boost::format("A matrix with %1% virtual inputs and %2% "
+                             "virtual outputs is not supported.") %
+               in_map_size % out_map_size)
+                .str());
+            break;
           }
+          DebugLog(std::string("Using the capabilities of the ") +
+                   found->name + ".");
 
-          for (uint8_t input = 1; input <= number_of_virtual_outputs; ++input) {
+          {
+            // tie() and tie_multiple() read these on the simulation thread.
+            std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
 
-            request_virtual_input_name(input);
+            model = found;
+            number_of_presets = ExtronModels::presets;
+            number_of_virtual_inputs = in_map_size;
+            number_of_virtual_outputs = out_map_size;
+            // Everything is sized once, so reading the ties and names of the
+            // matrix does not allocate.
+            current_input_of_output.resize(number_of_virtual_outputs, 0);
+            routing_snapshot.resize(number_of_virtual_outputs, 0);
+            outputs_of_input.assign(number_of_virtual_inputs + 1,
+                                    OutputSet());
+            for (uint16_t output = 1; output <= number_of_virtual_outputs;
+                 ++output) {
+              const uint16_t input = current_input_of_output[output - 1];
+              if (input < outputs_of_input.size())
+                outputs_of_input[input].set(output - 1);
+            }
           }
+          preset_ties.resize(number_of_presets);
+          for (std::vector<uint16_t>& ties : preset_ties)
+            ties.resize(number_of_virtual_outputs, 0);
+          preset_cached.resize(number_of_presets, false);
+          input_names.resize(number_of_virtual_inputs, "");
+          output_names.resize(number_of_virtual_outputs, "");
+          for (std::string& name : input_names)
+            name.reserve(ExtronModels::name_length);
+          for (std::string& name : output_names)
+            name.reserve(ExtronModels::name_length);
+          unverified_names.assign(
+            number_of_virtual_inputs + number_of_virtual_outputs, false);
+          unverified_name_count = 0;
+          next_name_to_audit = 0;
+          std::call_once(setupCallbackOnceFlag, setupCallback);
+          reserve_request_queues();
+
+          request_current_routing();
         }
 
         break;
@@ -375,12 +997,45 @@ void Device::process_response(const std::string& response)
         } else {
           unsigned int out = boost::lexical_cast<unsigned int>(m.str(1));
           unsigned int in = boost::lexical_cast<unsigned int>(m.str(2));
-          current_input_of_output[out] = in;
+          set_current_input(static_cast<uint16_t>(out),
+                            static_cast<uint16_t>(in));
           tieChanged(out, in);
         }
 
         break;
       }
+      case RequestType::MultiTie: {
+        if (!std::regex_match(response, ResponsePatterns::multi_tie)) {
+          reportError("Unable to interpret the 'quick multiple tie' response.");
+        } else {
+          // The device only acknowledges the whole batch, so the ties are
+          // taken from the request.
+          Parsing::for_each_tie(
+            request_in_progress.request,
+            [this](unsigned int in, unsigned int out) {
+              set_current_input(static_cast<uint16_t>(out),
+                                static_cast<uint16_t>(in));
+              tieChanged(out, in);
+            });
+        }
+
+        break;
+      }
+      case RequestType::TieAll: {
+        if (!std::regex_match(response, ResponsePatterns::tie_all)) {
+          reportError("Unable to interpret the 'tie to all' response.");
+        } else {
+          const uint16_t in = request_in_progress.index;
+          for (uint16_t out = 1; out <= current_input_of_output.size(); ++out) {
+            if (current_input_of_output[out - 1] != in) {
+              set_current_input(out, in);
+              tieChanged(out, in);
+            }
+          }
+        }
+
+        break;
+      }
       case RequestType::RequestCurrentConfiguration: {
         std::smatch m;
         std::regex_match(response, m, ResponsePatterns::current_configuration);
@@ -392,10 +1047,24 @@ void Device::process_response(const std::string& response)
             unsigned int in;
             response_stream >> in;
 
-            tieChanged(++viewed_current_outputs, static_cast<uint8_t>(in));
+            set_current_input(
+              static_cast<uint16_t>(viewed_current_outputs + 1),
+              static_cast<uint16_t>(in));
+            tieChanged(++viewed_current_outputs, static_cast<uint16_t>(in));
 
             if (viewed_current_outputs >= number_of_virtual_outputs) {
-              std::call_once(connectedCallbackOnceFlag, connectedCallback);
+              std::call_once(connectedCallbackOnceFlag, [this]() {
+                connectedCallback();
+                request_synchronized_names();
+              });
+
+              // This read verified a recall, so the preset has exactly this
+              // routing.
+              if (verifying_preset != 0) {
+                preset_ties[verifying_preset - 1] = current_input_of_output;
+                preset_cached[verifying_preset - 1] = true;
+                verifying_preset = 0;
+              }
               break;
             }
           }
@@ -403,12 +1072,60 @@ void Device::process_response(const std::string& response)
 
         break;
       }
+      case RequestType::RequestPresetConfiguration: {
+        std::smatch m;
+        std::regex_match(response, m, ResponsePatterns::current_configuration);
+        if (m.empty()) {
+          reportError("Unable to interpret the 'preset ties' response.");
+        } else {
+          std::vector<uint16_t>& ties =
+            preset_ties[request_in_progress.index - 1];
+
+          std::stringstream response_stream(response);
+          for (unsigned int output = request_in_progress.start_output;
+               output < request_in_progress.start_output + 16u &&
+               output <= number_of_virtual_outputs;
+               ++output) {
+            unsigned int in;
+            response_stream >> in;
+            ties[output - 1] = static_cast<uint16_t>(in);
+          }
+
+          if (request_in_progress.start_output + 16u >
+              number_of_virtual_outputs)
+            preset_cached[request_in_progress.index - 1] = true;
+        }
+
+        break;
+      }
+      case RequestType::Store: {
+        if (!std::regex_match(response, ResponsePatterns::store)) {
+          reportError("Unable to interpret the 'store' response.");
+        } else if (request_in_progress.index <= preset_ties.size()) {
+          // The matrix saved the current routing into the preset.
+          preset_ties[request_in_progress.index - 1] = current_input_of_output;
+          preset_cached[request_in_progress.index - 1] = true;
+        }
+        break;
+      }
+      case RequestType::Recall: {
+        if (!std::regex_match(response, ResponsePatterns::recall)) {
+          reportError("Unable to interpret the 'recall' response.");
+          // The routing is unknown, so it does not verify the preset.
+          verifying_preset = 0;
+        }
+        request_current_routing();
+        break;
+      }
       case RequestType::ReadVirtualInputName: {
+        name_verified(request_in_progress.index - 1u);
         input_names[request_in_progress.index - 1] = response;
         inputNameChanged(request_in_progress.index, response);
         break;
       }
       case RequestType::ReadVirtualOutputName: {
+        name_verified(number_of_virtual_inputs + request_in_progress.index -
+                      1u);
         output_names[request_in_progress.index - 1] = response;
         outputNameChanged(request_in_progress.index, response);
         break;
@@ -417,66 +1134,221 @@ void Device::process_response(const std::string& response)
         if (response != "NamI") {
           reportError(
             (boost::format("Unexpected response '%1%' with request %2%") %
-             response % request_in_progress.request)
+             response % request_in_progress.request.str())
               .str());
+          request_virtual_input_name(request_in_progress.index);
+          break;
         }
-        request_virtual_input_name(request_in_progress.index);
+        written_name_acknowledged(true);
         break;
       }
       case RequestType::WriteVirtualOutputName: {
         if (response != "NamO") {
           reportError(
             (boost::format("Unexpected response '%1%' with request %2%") %
-             response % request_in_progress.request)
+             response % request_in_progress.request.str())
               .str());
+          request_virtual_output_name(request_in_progress.index);
+          break;
         }
-        request_virtual_output_name(request_in_progress.index);
+        written_name_acknowledged(false);
+        break;
+      }
+      case RequestType::ProbeBaudRate: {
+        // Noise from a mismatched rate may end with a line feed, too.
+        if (!std::regex_match(response,
+                              ResponsePatterns::request_information)) {
+          probe_failed();
+          break;
+        }
+
+        verifying_baud_rate = false;
+        unanswered_probes = 0;
+        upgrade_baud_rate();
+        break;
+      }
+      case RequestType::SetBaudRate: {
+        const unsigned int rate = baud_rates[request_in_progress.index];
+        std::smatch m;
+        std::regex_match(response, m, ResponsePatterns::baud_rate);
+        if (m.empty() || boost::lexical_cast<unsigned int>(m.str(1)) != rate) {
+          reportError("Unable to interpret the 'baud rate' response.");
+          rejected_baud_rates |= 1u << request_in_progress.index;
+          upgrade_baud_rate();
+          break;
+        }
+
+        baud_rate = rate;
+        port.set_baud_rate(rate);
+        verifying_baud_rate = true;
+        probe_baud_rate();
         break;
       }
       default: {
         // Why did we get a response but did not expect one?
         reportError(
           (boost::format("Unexpected response '%1%' with request %2%") %
-           response % request_in_progress.request)
+           response % request_in_progress.request.str())
             .str());
         break;
       }
     }
   }
 
-  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
-
-  auto queues = { &high_priority_request_queue, &low_priority_request_queue };
-
-  for (auto& queue : queues) {
-    if (queue->size() == 0)
-      continue;
+  send_next_request();
+}
 
-    request_in_progress = queue->front();
-    queue->pop_front();
+void Device::send_next_request()
+{
+  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
 
+  while (
+    request_queue.pop(request_in_progress, SteadyClock::now())) {
     if (request_in_progress.type ==
         RequestType::BeginRequestCurrentConfiguration) {
       // Reset counter for which outputs we already processed
-      // RequestCurrentConfiguration.
+      // RequestCurrentConfiguration and send the next request.
       viewed_current_outputs = 0;
-
-      // Read the next request, if one is already in the queue.
-      if (queue->size() > 0) {
-        request_in_progress = queue->front();
-        queue->pop_front();
-      } else {
-        request_in_progress = { RequestType::None, "" };
-        continue;
-      }
+      continue;
     }
 
-    port.write_some(boost::asio::buffer(request_in_progress.request));
+    update_queue_depths();
+    write_request_in_progress();
     return;
   }
+  update_queue_depths();
+
+  // No queue contained any request, so use the idle time to cache the
+  // presets.
+  if (request_next_uncached_preset())
+    return;
+
+  // Verify the names that were trusted without reading them back.
+  if (request_next_name_audit())
+    return;
 
-  // No queue contained any request.
   request_in_progress = { RequestType::None, "" };
+  statistics.set_in_flight(false);
+}
+
+void Device::write_request_in_progress()
+{
+  name_read_dequeued(request_in_progress);
+
+  if (trace)
+    trace->record(SerialTrace::Kind::Promoted,
+                  static_cast<uint8_t>(request_in_progress.type),
+                  request_in_progress.number,
+                  nullptr,
+                  0,
+                  SerialTrace::Clock::now());
+
+  port.write(request_in_progress.request.data(),
+             request_in_progress.request.size());
+
+  request_sent_at = SteadyClock::now();
+  response_deadline = request_sent_at + response_timeout;
+  statistics.count_request(static_cast<size_t>(request_in_progress.type));
+  statistics.set_in_flight(true);
+
+  if (trace)
+    trace->record(SerialTrace::Kind::Sent,
+                  static_cast<uint8_t>(request_in_progress.type),
+                  request_in_progress.number,
+                  request_in_progress.request.data(),
+                  request_in_progress.request.size(),
+                  request_sent_at);
+}
+
+void Device::start_response_timer()
+{
+  response_timer.expires_after(response_check_interval);
+  response_timer.async_wait(boost::bind(
+    boost::mem_fn(&Device::timeout_handler), boost::ref(*this), _1));
+}
+
+void Device::timeout_handler(const boost::system::error_code& ec)
+{
+  if (ec == boost::asio::error::operation_aborted || !port.is_open())
+    return;
+
+  bool timed_out;
+  bool audit_due;
+  {
+    std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+
+    timed_out = request_in_progress.type != RequestType::None &&
+                SteadyClock::now() >= response_deadline;
+    audit_due = request_in_progress.type == RequestType::None &&
+                unverified_name_count > 0 &&
+                SteadyClock::now() >= next_name_audit;
+  }
+
+  if (timed_out) {
+    statistics.count_timeout();
+    if (trace) {
+      static const char reason[] = "timeout";
+      trace->record(SerialTrace::Kind::Completed,
+                    static_cast<uint8_t>(request_in_progress.type),
+                    request_in_progress.number,
+                    reason,
+                    sizeof(reason) - 1,
+                    SerialTrace::Clock::now());
+    }
+    // Probes are expected to go unanswered at the wrong baud rates.
+    if (request_in_progress.type != RequestType::ProbeBaudRate)
+      reportError((boost::format("No response to request %1%.") %
+                   request_in_progress.request.str())
+                    .str());
+    fail_request(request_in_progress);
+
+    send_next_request();
+  } else if (audit_due) {
+    // Nothing is sent while the device is idle, so start the audit here.
+    send_next_request();
+  }
+
+  std::lock_guard<std::mutex> lock_guard(request_queue_mutex);
+  if (port.is_open())
+    start_response_timer();
+}
+
+void Device::fail_request(const Request& request)
+{
+  switch (request.type) {
+    case RequestType::Tie:
+      tieFailed(request.index);
+      break;
+    case RequestType::MultiTie:
+      Parsing::for_each_tie(request.request,
+                            [this](unsigned int /*in*/, unsigned int out) {
+                              tieFailed(static_cast<uint16_t>(out));
+                            });
+      break;
+    case RequestType::TieAll:
+      for (uint16_t out = 1; out <= current_input_of_output.size(); ++out) {
+        if (current_input_of_output[out - 1] != request.index)
+          tieFailed(out);
+      }
+      break;
+    case RequestType::Recall:
+      // Only a sent recall published the cached preset, which the current
+      // routing corrects now.
+      if (request.index != 0) {
+        verifying_preset = 0;
+        request_current_routing();
+      }
+      break;
+    case RequestType::ProbeBaudRate:
+      probe_failed();
+      break;
+    case RequestType::SetBaudRate:
+      rejected_baud_rates |= 1u << request.index;
+      upgrade_baud_rate();
+      break;
+    default:
+      break;
+  }
 }
 
 void Device::read_handler(const boost::system::error_code& ec,
@@ -491,11 +1363,26 @@ void Device::read_handler(const boost::system::error_code& ec,
     return; // This seems to be the case when the port is closed, so we return
             // early.
 
+  if (trace && old_buffer.empty())
+    trace->record(SerialTrace::Kind::FirstByte,
+                  static_cast<uint8_t>(request_in_progress.type),
+                  request_in_progress.number,
+                  nullptr,
+                  0,
+                  SerialTrace::Clock::now());
+
   auto line_end =
     std::find(buffer.begin(), buffer.begin() + bytes_transferred, '\n');
 
   if (line_end != buffer.begin() + bytes_transferred) {
     old_buffer.insert(old_buffer.end(), buffer.begin(), line_end);
+    if (trace && !old_buffer.empty())
+      trace->record(SerialTrace::Kind::Received,
+                    static_cast<uint8_t>(request_in_progress.type),
+                    request_in_progress.number,
+                    reinterpret_cast<const char*>(old_buffer.data()),
+                    old_buffer.size() - 1,
+                    SerialTrace::Clock::now());
     process_response(std::string(
       old_buffer.begin(), old_buffer.end() - 1)); // omit \r from old_buffer
     old_buffer = std::vector<unsigned char>(std::next(line_end),
@@ -1,13 +1,23 @@
 #pragma once
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <functional>
 #include <mutex>
 #include <stdint.h>
 #include <vector>
 
 #include <boost/asio.hpp>
-#include <boost/asio/serial_port.hpp>
+
+#include "devicestatistics.h"
+#include "extronmodels.h"
+#include "requestbuffer.h"
+#include "requestscheduler.h"
+#include "serialport.h"
+#include "steadyclock.h"
+
+class SerialTrace;
 
 /**
  * @brief Interaction with the physical device.
@@ -25,37 +35,95 @@ public:
    */
   explicit Device(boost::asio::io_service& io_service);
 
-  uint8_t get_number_of_virtual_inputs() const;
+  uint16_t get_number_of_virtual_inputs() const;
+
+  uint16_t get_number_of_virtual_outputs() const;
 
-  uint8_t get_number_of_virtual_outputs() const;
+  //! Statistics of the communication, may be read from any thread.
+  const DeviceStatistics& get_statistics() const;
+
+  //! Set of outputs, bit 0 is output 1.
+  using OutputSet = std::bitset<ExtronModels::max_outputs>;
+
+  /**
+   * @brief Outputs the input is routed to, without scanning all outputs.
+   * @param input 1-based index of the input or 0 for the untied outputs
+   * @note Only call it on the io service thread, i.e. from a callback.
+   */
+  const OutputSet& get_outputs_of_input(uint16_t input) const;
+
+  //! Number of outputs the input is routed to, see get_outputs_of_input().
+  uint16_t count_outputs_of_input(uint16_t input) const;
 
 private:
+  // model, the numbers of virtual channels and current_input_of_output are
+  // written by the io service and read by tie() and tie_multiple() on the
+  // simulation thread, so they are guarded by request_queue_mutex.
+
+  //! Series of the connected matrix, nullptr until the information was read.
+  const ExtronModel* model;
   //! Number of presets the device supports.
-  const uint8_t number_of_presets;
+  uint16_t number_of_presets;
   //! Number of virtual inputs the device has.
-  uint8_t number_of_virtual_inputs;
+  uint16_t number_of_virtual_inputs;
   //! Number of virtual outputs the device has.
-  uint8_t number_of_virtual_outputs;
+  uint16_t number_of_virtual_outputs;
 
   // Device state
 private:
-  std::vector<uint8_t> current_input_of_output;
+  std::vector<uint16_t> current_input_of_output;
+  //! Copy of current_input_of_output which tie_multiple() diffs against.
+  std::vector<uint16_t> routing_snapshot;
+  //! Reverse index of current_input_of_output, index 0 are the untied outputs.
+  std::vector<OutputSet> outputs_of_input;
+  //! Record that an input is routed to an output, keeping the index in sync.
+  //! Must not be called with request_queue_mutex held.
+  void set_current_input(uint16_t output, uint16_t input);
   std::vector<std::string> input_names;
   std::vector<std::string> output_names;
 
+  //! Ties of each preset, index 0 is preset 1.
+  std::vector<std::vector<uint16_t>> preset_ties;
+  //! Whether the ties of a preset were read or stored.
+  std::vector<bool> preset_cached;
+  //! 1-based index of the next preset to read when there is nothing else to
+  //! do.
+  unsigned int next_preset_to_cache;
+  //! 1-based index of the recalled preset whose routing is being verified.
+  unsigned int verifying_preset;
+
   // Device communication (serial port)
 public:
   /**
    * @brief Open a connection to the serial port.
    * @param port_name Path to the serial port, i.e. /dev/ttyUSB0.
+   * @param baud_rate bits per second to start with
+   * @param negotiate_baud_rate find the rate of the device by probing each of
+   * baud_rates and switch both sides to the fastest one that works before
+   * reading the configuration
    */
-  void open(const std::string& port_name);
+  void open(const std::string& port_name,
+            unsigned int baud_rate = 9600,
+            bool negotiate_baud_rate = false);
 
   /**
    * @brief Close the connection to the serial port.
    */
   void close();
 
+  /**
+   * @brief Record all requests and responses.
+   * @param trace open trace to record into or nullptr to stop recording, must
+   * outlive the connection
+   */
+  void set_trace(SerialTrace* trace);
+
+  //! Bits per second currently used on the serial port.
+  unsigned int get_baud_rate() const;
+
+  //! Rates the device is probed at and may be switched to, slowest first.
+  static const std::array<unsigned int, 4> baud_rates;
+
 private:
   /**
    * @brief Called when bytes were read from the serial port.
@@ -66,12 +134,36 @@ private:
                     std::size_t bytes_transferred);
 
   //! The serial port through which to communicate with the device.
-  boost::asio::serial_port port;
+  SerialPort port;
 
   //! Holds data when reading 16 bytes did not return a complete message
   std::vector<unsigned char> old_buffer;
   std::vector<unsigned char> buffer;
 
+  //! Periodically checks whether the response to the request in progress is
+  //! overdue. It runs continuously, so sending a request only stores the
+  //! deadline and does not start an asynchronous wait.
+  SteadyTimer response_timer;
+  //! Time by which the device must have responded to the request in progress.
+  SteadyClock::time_point response_deadline;
+  //! Time the request in progress was sent.
+  SteadyClock::time_point request_sent_at;
+
+  DeviceStatistics statistics;
+  SerialTrace* trace = nullptr;
+
+  //! Whether the baud rate is negotiated before reading the configuration.
+  bool negotiate_baud_rate = false;
+  //! Bits per second currently used on the serial port.
+  std::atomic<unsigned int> baud_rate{ 9600 };
+  //! Whether the probe in progress checks a rate the device was just switched
+  //! to, rather than searching for the rate of the device.
+  bool verifying_baud_rate = false;
+  //! Number of probes in a row which the device did not answer.
+  unsigned int unanswered_probes = 0;
+  //! Bit i is set if switching to baud_rates[i] failed.
+  unsigned int rejected_baud_rates = 0;
+
   // Protocol (message level)
 public:
   //! The type of request to determine how to handle the response.
@@ -81,47 +173,67 @@ public:
     RequestInformation,
     BeginRequestCurrentConfiguration,
     RequestCurrentConfiguration,
+    RequestPresetConfiguration,
     Tie,
+    MultiTie,
     Store,
     Recall,
     ReadVirtualInputName,
     WriteVirtualInputName,
     ReadVirtualOutputName,
     WriteVirtualOutputName,
+    ProbeBaudRate,
+    SetBaudRate,
+    TieAll,
   };
 
   //! A request to send to the device.
   struct Request
   {
 
+    Request() = default;
+
     // Remove when N3653 is available:
-    Request(RequestType type, const std::string& request)
+    Request(RequestType type, const RequestBuffer& request)
+      : type(type)
+      , request(request)
+    {}
+
+    Request(RequestType type, const RequestBuffer& request, uint16_t index)
       : type(type)
       , request(request)
+      , index(index)
     {}
 
-    Request(RequestType type, const std::string& request, uint8_t index)
+    Request(RequestType type,
+            const RequestBuffer& request,
+            uint16_t index,
+            uint16_t start_output)
       : type(type)
       , request(request)
       , index(index)
+      , start_output(start_output)
     {}
 
     //! The type of the request.
-    RequestType type;
-    //! The formatted request.
-    std::string request;
+    RequestType type{ RequestType::None };
+    //! The formatted request. Kept inline so queueing a request does not
+    //! allocate.
+    RequestBuffer request;
 
-    //! Only used for requesting names. Index of the input/output.
-    uint8_t index{ 0 };
-  };
+    //! Only used for requesting names and presets. Index of the
+    //! input/output/preset.
+    uint16_t index{ 0 };
 
-private:
-  enum class QueueType
-  {
-    HighPriority,
-    LowPriority
+    //! Only used for requesting presets. First output of the response.
+    uint16_t start_output{ 0 };
+
+    //! Number in the order the requests were queued, identifies the request
+    //! in a trace.
+    uint32_t number{ 0 };
   };
 
+private:
   //! Put requests into the request queue to read for all outputs the mapped
   //! inputs.
   void initialize();
@@ -129,14 +241,70 @@ private:
   void request_begin_current_configuration_requests();
   void request_current_configuration(unsigned int start_output);
 
-  void request_virtual_output_name(uint8_t output);
-  void request_virtual_input_name(uint8_t input);
+  //! Queue the reads of the ties of all outputs behind their marker.
+  void request_current_routing();
+
+  //! Queue the reads of the ties of the next uncached preset. Must be called
+  //! with request_queue_mutex held.
+  //! @return false if all presets are cached
+  bool request_next_uncached_preset();
+
+  //! Publish the cached ties of a preset as the current routing.
+  void apply_cached_preset(unsigned int index);
+
+  void request_virtual_output_name(uint16_t output);
+  void request_virtual_input_name(uint16_t input);
+
+  //! Read back or publish the name acknowledged for the request in progress.
+  //! @param inputs whether the name is one of an input
+  void written_name_acknowledged(bool inputs);
+
+  //! Mark a name as read from the matrix.
+  //! @param channel index into unverified_names
+  void name_verified(size_t channel);
+
+  //! Read the next name written without verification if the audit is due.
+  //! Must be called with request_queue_mutex held.
+  //! @return false if no name was read
+  bool request_next_name_audit();
+
+  //! Request the information to find out whether the device answers at the
+  //! current baud rate.
+  void probe_baud_rate();
+
+  //! Switch the device to the fastest rate which was not rejected yet, or
+  //! start reading the configuration if the current rate is the fastest.
+  void upgrade_baud_rate();
+
+  //! Continue probing at the next rate after a probe failed.
+  void probe_failed();
 
   //! Put a request into the request queue or directly execute it if there is no
-  //! request in progress.
-  void add_to_queue(Request command, QueueType queueType);
+  //! request in progress. Fails the request if its queue is full or if it did
+  //! not fit into its RequestBuffer.
+  void add_to_queue(Request command, RequestClass request_class);
 
-  void clear_queue(QueueType queueType);
+  //! Fail a request without sending it. Callbacks are only called from the io
+  //! service, so the caller may hold its own locks.
+  void reject_request(const Request& request, const std::string& error);
+
+  //! Number a request about to be queued and trace it. Must be called with
+  //! request_queue_mutex held.
+  void enqueued(Request& request);
+
+  //! Size the request queues for the number of virtual inputs and outputs.
+  void reserve_request_queues();
+
+  //! Publish the depths of the request queues. Must be called with
+  //! request_queue_mutex held.
+  void update_queue_depths();
+
+  //! Count the response to the request in progress.
+  void count_response();
+
+  //! Drop all queued requests. The dropped ties are failed from the io
+  //! service.
+  void clear_queues();
 
   /**
    * @brief Process a complete response.
@@ -144,62 +312,177 @@ private:
    */
   void process_response(const std::string& response);
 
+  //! Make the next queued request the request in progress and send it.
+  void send_next_request();
+
+  //! Send the request in progress and wait for its response. Must be called
+  //! with request_queue_mutex held.
+  void write_request_in_progress();
+
+  //! Wait for the next check of the response deadline.
+  void start_response_timer();
+
+  /**
+   * @brief Called periodically to fail the request in progress when the device
+   * did not respond in time.
+   * @param ec error code
+   */
+  void timeout_handler(const boost::system::error_code& ec);
+
+  //! Report the outputs of a failed tie request.
+  void fail_request(const Request& request);
+
   //! Protect the request queue from concurrent access by the io service and
   //! zeromq.
   std::mutex request_queue_mutex;
-  //! Queue of requests to send to the device.
-  std::deque<Request> low_priority_request_queue;
-  std::deque<Request> high_priority_request_queue;
+  //! Queues of requests to send to the device. They have a fixed capacity
+  //! which is sized once the dimensions of the device are known.
+  RequestScheduler<Request> request_queue;
   //! The request which is currently sent to the device or whose response is
   //! being read and processed.
   Request request_in_progress;
+  //! Number of the next request which is queued.
+  uint32_t next_request_number = 1;
 
   //!
-  uint8_t viewed_current_outputs;
+  uint16_t viewed_current_outputs;
 
   // Device interaction (RegieControlSystem level)
 public:
   /**
    * @brief Map an audio and video input to an output.
+   *
+   * Ties out of the range of the matrix are failed without sending them.
+   *
    * @param input 1-based index of the input [1 <= input <= number_of_inputs]
    * @param output 1-based index of the output [1 <= output <=
    * number_of_outputs]
    */
   void tie(unsigned int input, unsigned int output);
 
+  /**
+   * @brief Map several inputs to outputs at once.
+   *
+   * Only the outputs whose input differs from the current routing are sent to
+   * the device in quick multiple ties. A new quick multiple tie is started
+   * whenever one would not fit into a RequestBuffer.
+   *
+   * @param input_of_output input for each output, index 0 is output 1
+   */
+  void tie_multiple(const std::vector<unsigned int>& input_of_output);
+
   /**
    * @brief Store the current setup to a local preset.
-   * @param index 1-based preset index
+   * @param index 1-based preset index, presets the model does not have are
+   * rejected without sending them
    */
   void store(unsigned int index);
 
   /**
    * @brief Recall the current setup from a local preset.
-   * @param index 1-based preset index
+   * @param index 1-based preset index, presets the model does not have are
+   * rejected without sending them
    */
   void recall(unsigned int index);
 
-  void set_input_name(uint8_t index, const std::string& name);
-  void set_output_name(uint8_t index, const std::string& name);
+  //! Names longer than the model keeps are cut off.
+  void set_input_name(uint16_t index, const std::string& name);
+  void set_output_name(uint16_t index, const std::string& name);
 
+  /**
+   * @brief Choose the names which are kept in sync with the matrix.
+   *
+   * They are read in the background once the routing was read, so they do
+   * not delay connectedCallback. By default all names are read.
+   * @param inputs number of input names to read, starting with input 1
+   * @param outputs number of output names to read, starting with output 1
+   */
+  void set_synchronized_names(uint16_t inputs, uint16_t outputs);
+
+  //! How a written name is confirmed after the matrix acknowledged it.
+  enum class NameVerification : uint8_t
+  {
+    //! Read every written name back.
+    Always = 0,
+    //! Read back every name_verification_sample-th written name.
+    Sampled,
+    //! Publish the written name right away.
+    TrustAck,
+  };
+
+  /**
+   * @brief Choose how written names are verified.
+   *
+   * Names which are not read back right away are read one at a time by a
+   * periodic audit when there is nothing else to do.
+   */
+  void set_name_verification(NameVerification verification);
+
+  //! With NameVerification::Sampled one of this many written names is read
+  //! back.
+  static const unsigned int name_verification_sample = 8;
+
+private:
+  //! Read the names chosen by set_synchronized_names().
+  void request_synchronized_names();
+
+  /**
+   * @brief Mark a read of a name as queued unless it is already.
+   * @param channel index of the name, inputs first, then outputs
+   * @return false if a read of the name is queued already
+   */
+  bool queue_name_read(size_t channel);
+
+  //! Forget that a read of a name is queued once it is sent or dropped. Must
+  //! be called with request_queue_mutex held.
+  void name_read_dequeued(const Request& request);
+
+  //! Whether a read of each name waits in the queue, inputs first, then
+  //! outputs. A burst of notifications then reads each name only once.
+  //! Guarded by request_queue_mutex.
+  std::vector<bool> queued_name_reads;
+
+  uint16_t synchronized_input_names = UINT16_MAX;
+  uint16_t synchronized_output_names = UINT16_MAX;
+  NameVerification name_verification = NameVerification::Always;
+  //! Number of names acknowledged so far, to sample them.
+  unsigned int acknowledged_names = 0;
+  //! Whether each name was written without reading it back. Inputs first,
+  //! then outputs.
+  std::vector<bool> unverified_names;
+  //! Number of set entries of unverified_names.
+  size_t unverified_name_count = 0;
+  //! Position in unverified_names the audit continues at.
+  size_t next_name_to_audit = 0;
+  //! Earliest time of the next read of the audit.
+  SteadyClock::time_point next_name_audit;
+
+public:
   /**
    * @brief Callback being called when an video input was mapped to an output.
    */
-  std::function<void(uint8_t out, uint8_t in)> tieChanged;
+  std::function<void(uint16_t out, uint16_t in)> tieChanged;
+
+  /**
+   * @brief Callback being called when a requested tie was rejected by the
+   * device or not answered in time.
+   * @param out 1-based index of the output whose routing did not change
+   */
+  std::function<void(uint16_t out)> tieFailed;
 
   /**
    * @brief Name of an input has changed.
    * @param input 1-based index of the input [1 <= input <= number_of_inputs]
    * @param name new name of the input
    */
-  std::function<void(uint8_t input, std::string name)> inputNameChanged;
+  std::function<void(uint16_t input, std::string name)> inputNameChanged;
 
   /**
    * @brief Name of an output has changed.
    * @param input 1-based index of the output [1 <= input <= number_of_outputs]
    * @param name new name of the output
    */
-  std::function<void(uint8_t output, std::string name)> outputNameChanged;
+  std::function<void(uint16_t output, std::string name)> outputNameChanged;
 
   /**
    * @brief Callback being called when the device is connected and initialized.
@@ -0,0 +1,150 @@
+#include "devicestatistics.h"
+
+namespace {
+const auto relaxed = std::memory_order_relaxed;
+}
+
+void DeviceStatistics::count_request(size_t type)
+{
+  if (type < requests.size())
+    requests[type].fetch_add(1, relaxed);
+}
+
+void DeviceStatistics::count_response(
+  std::chrono::steady_clock::duration round_trip)
+{
+  responses.fetch_add(1, relaxed);
+
+  const auto microseconds =
+    std::chrono::duration_cast<std::chrono::microseconds>(round_trip).count();
+  round_trips[bucket_of(microseconds > 0 ? microseconds : 0)].fetch_add(
+    1, relaxed);
+}
+
+void DeviceStatistics::count_error()
+{
+  errors.fetch_add(1, relaxed);
+}
+
+void DeviceStatistics::count_timeout()
+{
+  timeouts.fetch_add(1, relaxed);
+}
+
+void DeviceStatistics::count_dropped()
+{
+  dropped.fetch_add(1, relaxed);
+}
+
+void DeviceStatistics::set_queue_depth(size_t request_class, size_t depth)
+{
+  if (request_class < queue_depths.size())
+    queue_depths[request_class].store(depth, relaxed);
+}
+
+void DeviceStatistics::set_in_flight(bool in_flight)
+{
+  this->in_flight.store(in_flight, relaxed);
+}
+
+uint64_t DeviceStatistics::get_requests() const
+{
+  uint64_t sum = 0;
+  for (const auto& count : requests)
+    sum += count.load(relaxed);
+  return sum;
+}
+
+uint64_t DeviceStatistics::get_requests(size_t type) const
+{
+  return type < requests.size() ? requests[type].load(relaxed) : 0;
+}
+
+uint64_t DeviceStatistics::get_responses() const
+{
+  return responses.load(relaxed);
+}
+
+uint64_t DeviceStatistics::get_errors() const
+{
+  return errors.load(relaxed);
+}
+
+uint64_t DeviceStatistics::get_timeouts() const
+{
+  return timeouts.load(relaxed);
+}
+
+uint64_t DeviceStatistics::get_dropped() const
+{
+  return dropped.load(relaxed);
+}
+
+size_t DeviceStatistics::get_queue_depth() const
+{
+  size_t sum = 0;
+  for (const auto& depth : queue_depths)
+    sum += depth.load(relaxed);
+  return sum;
+}
+
+size_t DeviceStatistics::get_queue_depth(size_t request_class) const
+{
+  return request_class < queue_depths.size()
+           ? queue_depths[request_class].load(relaxed)
+           : 0;
+}
+
+bool DeviceStatistics::get_in_flight() const
+{
+  return in_flight.load(relaxed);
+}
+
+std::chrono::microseconds DeviceStatistics::get_round_trip(
+  double quantile) const
+{
+  std::array<uint64_t, bucket_count> counts;
+  uint64_t total = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    counts[i] = round_trips[i].load(relaxed);
+    total += counts[i];
+  }
+  if (total == 0)
+    return std::chrono::microseconds(0);
+
+  // Number of responses which must be at or below the result.
+  const uint64_t rank = static_cast<uint64_t>(quantile * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::chrono::microseconds(upper_bound_of(i));
+  }
+  return std::chrono::microseconds(upper_bound_of(bucket_count - 1));
+}
+
+size_t DeviceStatistics::bucket_of(uint64_t microseconds)
+{
+  if (microseconds < 4)
+    return static_cast<size_t>(microseconds);
+
+  size_t exponent = 2;
+  while (exponent < 63 && (microseconds >> (exponent + 1)) != 0)
+    ++exponent;
+
+  // The two bits after the highest one select the quarter.
+  const size_t quarter =
+    static_cast<size_t>(microseconds >> (exponent - 2)) & 3;
+  const size_t bucket = 4 * (exponent - 1) + quarter;
+  return bucket < bucket_count ? bucket : bucket_count - 1;
+}
+
+uint64_t DeviceStatistics::upper_bound_of(size_t bucket)
+{
+  if (bucket < 4)
+    return bucket;
+
+  const size_t exponent = bucket / 4 + 1;
+  const uint64_t quarter = bucket % 4;
+  return ((4 + quarter + 1) << (exponent - 2)) - 1;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters and histograms of the communication with the device.
+ *
+ * Updated from the io thread and the simulation thread and read from any
+ * thread without locks. Every value is updated on its own, so values read
+ * together may be from slightly different moments.
+ */
+class DeviceStatistics
+{
+public:
+  //! Number of request types which are counted separately.
+  static const size_t max_request_types = 16;
+  //! Number of request classes whose queue depth is tracked.
+  static const size_t max_request_classes = 4;
+
+  // Recording
+public:
+  void count_request(size_t type);
+  //! Count a response and record how long the device took to send it.
+  void count_response(std::chrono::steady_clock::duration round_trip);
+  void count_error();
+  void count_timeout();
+  void count_dropped();
+  void set_queue_depth(size_t request_class, size_t depth);
+  void set_in_flight(bool in_flight);
+
+  // Reading
+public:
+  //! Requests sent of all types.
+  uint64_t get_requests() const;
+  uint64_t get_requests(size_t type) const;
+  uint64_t get_responses() const;
+  //! Error responses of the device.
+  uint64_t get_errors() const;
+  //! Requests the device did not respond to in time.
+  uint64_t get_timeouts() const;
+  //! Requests dropped because their queue was full.
+  uint64_t get_dropped() const;
+  //! Queued requests of all classes.
+  size_t get_queue_depth() const;
+  size_t get_queue_depth(size_t request_class) const;
+  //! Whether a request was sent and its response is outstanding.
+  bool get_in_flight() const;
+
+  /**
+   * @brief Round trip time below which a share of the responses arrived.
+   *
+   * The round trip times are kept in buckets of a quarter of a power of two,
+   * so the result is at most 25% too large.
+   *
+   * @param quantile share of the responses [0 <= quantile <= 1]
+   * @return zero if there was no response
+   */
+  std::chrono::microseconds get_round_trip(double quantile) const;
+
+private:
+  //! Four buckets for every power of two of microseconds.
+  static const size_t bucket_count = 128;
+
+  static size_t bucket_of(uint64_t microseconds);
+  //! Largest round trip time in microseconds of a bucket.
+  static uint64_t upper_bound_of(size_t bucket);
+
+  std::array<std::atomic<uint64_t>, max_request_types> requests{};
+  std::atomic<uint64_t> responses{ 0 };
+  std::atomic<uint64_t> errors{ 0 };
+  std::atomic<uint64_t> timeouts{ 0 };
+  std::atomic<uint64_t> dropped{ 0 };
+  std::array<std::atomic<size_t>, max_request_classes> queue_depths{};
+  std::atomic<bool> in_flight{ false };
+  std::array<std::atomic<uint64_t>, bucket_count> round_trips{};
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <assert.h>
 #include <mutex>
 #include <thread>
@@ -15,6 +16,30 @@ const char* ApplicationName = "Extron-Matrix";
 
 std::unique_ptr<Simulation> simulation;
 Configuration configuration;
+
+//! Name an OUT pin, which holds several outputs with compact pins or all of
+//! them with $MAP pins.
+void RoutingPinName(unsigned int pin, unsigned char* Name)
+{
+  // Casting is ok because the source string is only ASCII, so most
+  // significant bit doesn't matter.
+  char* name = reinterpret_cast<char*>(Name);
+  if (configuration.mapPins) {
+    strcpy(name, "$MAP");
+    return;
+  }
+  if (!configuration.compactPins) {
+    sprintf(name, "OUT%u", pin);
+    return;
+  }
+
+  const unsigned int first = pin * Configuration::outputs_per_compact_pin;
+  const unsigned int last =
+    std::min(first + Configuration::outputs_per_compact_pin,
+             configuration.outputs) -
+    1;
+  sprintf(name, "OUT%u-%u", first, last);
+}
 } // namespace
 
 /**
@@ -45,12 +70,8 @@ DLLEXPORT unsigned char __stdcall CNumInputsEx(double* PUser)
 {
   configuration = Configuration(PUser);
   if (configuration.present) {
-    unsigned int numberOfInputs = configuration.outputs + 2;
-    if (configuration.includeInputNames)
-      numberOfInputs += 1;
-    if (configuration.includeOutputNames)
-      numberOfInputs += 1;
-    assert(numberOfInputs <= std::numeric_limits<unsigned char>::max());
+    const unsigned int numberOfInputs = configuration.InputPins();
+    assert(numberOfInputs <= Configuration::max_pins);
     return static_cast<unsigned char>(numberOfInputs);
   } else {
     // For some reason ProfiLab calls us without the PUser from the saved
@@ -68,12 +89,8 @@ DLLEXPORT unsigned char __stdcall CNumOutputsEx(double* PUser)
   configuration = Configuration(PUser);
 
   if (configuration.present) {
-    unsigned int numberOfOutputs = configuration.outputs + 3;
-    if (configuration.includeInputNames)
-      numberOfOutputs += 1;
-    if (configuration.includeOutputNames)
-      numberOfOutputs += 1;
-    assert(numberOfOutputs <= std::numeric_limits<unsigned char>::max());
+    const unsigned int numberOfOutputs = configuration.OutputPins();
+    assert(numberOfOutputs <= Configuration::max_pins);
     return static_cast<unsigned char>(numberOfOutputs);
   } else {
     // For some reason ProfiLab calls us without the PUser from the saved
@@ -93,6 +110,7 @@ DLLEXPORT void __stdcall GetInputName(unsigned char Channel,
   static const std::string recallInputName = "RECALL";
   static const std::string inputNames = "$INS";
   static const std::string outputNames = "$OUTS";
+  static const std::string takeInputName = "TAKE";
 
   switch (Channel) {
     case 0:
@@ -103,14 +121,12 @@ DLLEXPORT void __stdcall GetInputName(unsigned char Channel,
       break;
     default:
       Channel -= 2; // without the above inputs
-      if (Channel < configuration.outputs) {
-        // Casting is ok because the source string is only ASCII, so most
-        // significant bit doesn't matter.
-        sprintf(reinterpret_cast<char*>(Name), "OUT%d", Channel);
+      if (Channel < configuration.RoutingPins()) {
+        RoutingPinName(Channel, Name);
         return;
       }
 
-      Channel -= configuration.outputs;
+      Channel -= configuration.RoutingPins();
 
       if (configuration.includeInputNames) {
         if (Channel == 0) {
@@ -125,6 +141,15 @@ DLLEXPORT void __stdcall GetInputName(unsigned char Channel,
         if (Channel == 0) {
           memcpy(Name, outputNames.c_str(), outputNames.size() + 1);
           return;
+        } else {
+          --Channel;
+        }
+      }
+
+      if (configuration.stagedRouting) {
+        if (Channel == 0) {
+          memcpy(Name, takeInputName.c_str(), takeInputName.size() + 1);
+          return;
         }
       }
 
@@ -143,6 +168,7 @@ DLLEXPORT void __stdcall GetOutputName(unsigned char Channel,
   static const std::string errorStringOutputName = "$ERR";
   static const std::string inputNames = "$INS";
   static const std::string outputNames = "$OUTS";
+  static const std::string pendingOutputName = "PENDING";
 
   switch (Channel) {
     case 0:
@@ -157,14 +183,12 @@ DLLEXPORT void __stdcall GetOutputName(unsigned char Channel,
       break;
     default:
       Channel -= 3; // without the above inputs
-      if (Channel < configuration.outputs) {
-        // Casting is ok because the source string is only ASCII, so most
-        // significant bit doesn't matter.
-        sprintf(reinterpret_cast<char*>(Name), "OUT%d", Channel);
+      if (Channel < configuration.RoutingPins()) {
+        RoutingPinName(Channel, Name);
         return;
       }
 
-      Channel -= configuration.outputs;
+      Channel -= configuration.RoutingPins();
 
       if (configuration.includeInputNames) {
         if (Channel == 0) {
@@ -179,9 +203,35 @@ DLLEXPORT void __stdcall GetOutputName(unsigned char Channel,
         if (Channel == 0) {
           memcpy(Name, outputNames.c_str(), outputNames.size() + 1);
           return;
+        } else {
+          --Channel;
+        }
+      }
+
+      if (configuration.optimisticTies) {
+        if (Channel == 0) {
+          memcpy(Name, pendingOutputName.c_str(), pendingOutputName.size() + 1);
+          return;
+        } else {
+          --Channel;
         }
       }
 
+      if (configuration.statisticsPins) {
+        if (Channel < Simulation::StatisticsPinNames.size()) {
+          strcpy(reinterpret_cast<char*>(Name),
+                 Simulation::StatisticsPinNames[Channel]);
+          return;
+        } else {
+          Channel -= Simulation::StatisticsPinNames.size();
+        }
+      }
+
+      if (configuration.tallyPins && Channel < configuration.inputs) {
+        sprintf(reinterpret_cast<char*>(Name), "TALLY%u", Channel + 1);
+        return;
+      }
+
       Name[0] = '\0';
   }
 }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+
+/**
+ * @brief Size limits of a series of Extron matrix switchers.
+ *
+ * Knowing them up front lets Device reject requests the matrix would answer
+ * with an error and size its state once, without asking the matrix. The
+ * series only differ in their size, everything else they share is in
+ * ExtronModels.
+ */
+struct ExtronModel
+{
+  //! Name of the series as printed on the frame.
+  const char* name;
+  //! Largest number of virtual inputs a matrix of the series can have.
+  unsigned int max_inputs;
+  //! Largest number of virtual outputs a matrix of the series can have.
+  unsigned int max_outputs;
+};
+
+namespace ExtronModels {
+
+//! Supported series, smallest first.
+inline constexpr std::array<ExtronModel, 3> models{ {
+  { "Matrix 3200", 32, 32 },
+  { "Matrix 6400", 64, 64 },
+  { "Matrix 12800", 128, 128 },
+} };
+
+//! Number of global presets of every series, numbered from 1.
+inline constexpr unsigned int presets = 32;
+
+//! Number of characters of a virtual input or output name every series keeps.
+inline constexpr size_t name_length = 12;
+
+//! Most virtual outputs of any supported series.
+inline constexpr unsigned int max_outputs = models.back().max_outputs;
+
+/**
+ * @brief Find the series of a matrix from its virtual size.
+ * @return the smallest series which can have that many virtual inputs and
+ * outputs or nullptr if none can
+ */
+constexpr const ExtronModel* find(unsigned int inputs, unsigned int outputs)
+{
+  for (const ExtronModel& model : models) {
+    if (inputs <= model.max_inputs && outputs <= model.max_outputs)
+      return &model;
+  }
+  return nullptr;
+}
+
+static_assert(find(12, 8) == &models[0], "A small matrix is a Matrix 3200");
+static_assert(find(33, 16) == &models[1], "Any side may exceed a series");
+static_assert(find(128, 129) == nullptr, "The largest series is the limit");
+
+}
@@ -0,0 +1,38 @@
+#include "listserialports.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <set>
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> listSerialPorts()
+{
+  std::vector<std::string> ports;
+  std::error_code ec;
+
+  // USB adapters have stable names here, which survive replugging them.
+  std::set<fs::path> linked;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator("/dev/serial/by-id", ec)) {
+    ports.push_back(entry.path().string());
+    linked.insert(fs::canonical(entry.path(), ec));
+  }
+
+  // Only ttys with a device behind them are serial ports, the others are
+  // consoles and pseudo terminals.
+  std::vector<std::string> devices;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator("/sys/class/tty", ec)) {
+    if (!fs::exists(entry.path() / "device", ec))
+      continue;
+
+    const fs::path device = fs::path("/dev") / entry.path().filename();
+    if (linked.count(device) == 0)
+      devices.push_back(device.string());
+  }
+  std::sort(devices.begin(), devices.end());
+  ports.insert(ports.end(), devices.begin(), devices.end());
+
+  return ports;
+}
@@ -0,0 +1,118 @@
+#include "presetlibrary.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+const char magic[4] = { 'E', 'X', 'P', 'L' };
+const uint8_t version = 1;
+
+template<typename T>
+void append(std::vector<char>& data, T value)
+{
+  const char* begin = reinterpret_cast<const char*>(&value);
+  data.insert(data.end(), begin, begin + sizeof(value));
+}
+
+template<typename T>
+bool read(const std::vector<char>& data, size_t& offset, T& value)
+{
+  if (data.size() - offset < sizeof(value))
+    return false;
+  memcpy(&value, data.data() + offset, sizeof(value));
+  offset += sizeof(value);
+  return true;
+}
+} // namespace
+
+PresetLibrary::PresetLibrary(const std::string& path)
+  : path(path)
+{}
+
+bool PresetLibrary::Load()
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    // Nothing stored yet.
+    presets.clear();
+    return true;
+  }
+
+  std::vector<char> data{ std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>() };
+  return Deserialize(data);
+}
+
+bool PresetLibrary::Save() const
+{
+  const std::vector<char> data = Serialize();
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(data.data(), data.size());
+  return file.good();
+}
+
+void PresetLibrary::Store(unsigned int index,
+                          const std::vector<unsigned int>& input_of_output)
+{
+  presets[index] = input_of_output;
+}
+
+const std::vector<unsigned int>* PresetLibrary::Find(unsigned int index) const
+{
+  auto it = presets.find(index);
+  return it == presets.end() ? nullptr : &it->second;
+}
+
+std::vector<char> PresetLibrary::Serialize() const
+{
+  // Layout: magic, version, number of presets and for each preset its index,
+  // number of outputs and one byte per output.
+  std::vector<char> data(std::begin(magic), std::end(magic));
+  append(data, version);
+  append(data, static_cast<uint32_t>(presets.size()));
+
+  for (const auto& preset : presets) {
+    append(data, static_cast<uint32_t>(preset.first));
+    append(data, static_cast<uint16_t>(preset.second.size()));
+    for (unsigned int input : preset.second)
+      append(data, static_cast<uint8_t>(input));
+  }
+
+  return data;
+}
+
+bool PresetLibrary::Deserialize(const std::vector<char>& data)
+{
+  if (data.size() < sizeof(magic) ||
+      memcmp(data.data(), magic, sizeof(magic)) != 0)
+    return false;
+
+  size_t offset = sizeof(magic);
+  uint8_t data_version;
+  uint32_t count;
+  if (!read(data, offset, data_version) || data_version != version ||
+      !read(data, offset, count))
+    return false;
+
+  std::map<unsigned int, std::vector<unsigned int>> read_presets;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t index;
+    uint16_t outputs;
+    if (!read(data, offset, index) || !read(data, offset, outputs))
+      return false;
+
+    std::vector<unsigned int>& preset = read_presets[index];
+    preset.reserve(outputs);
+    for (uint16_t output = 0; output < outputs; ++output) {
+      uint8_t input;
+      if (!read(data, offset, input))
+        return false;
+      preset.push_back(input);
+    }
+  }
+
+  presets = std::move(read_presets);
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Presets stored on the host instead of the device.
+ *
+ * The number of presets is not limited by the device and recalling a preset
+ * only needs to send the ties that differ from the current routing.
+ */
+class PresetLibrary
+{
+public:
+  /**
+   * @brief Construct an empty library.
+   * @param path file the library is loaded from and saved to
+   */
+  explicit PresetLibrary(const std::string& path);
+
+  /**
+   * @brief Read all presets from the file.
+   * @return false if the file exists but could not be read
+   */
+  bool Load();
+
+  /**
+   * @brief Write all presets to the file.
+   * @return false if the file could not be written
+   */
+  bool Save() const;
+
+  /**
+   * @brief Store the routing as preset.
+   * @param index 1-based preset index
+   * @param input_of_output input for each output, index 0 is output 1
+   */
+  void Store(unsigned int index,
+             const std::vector<unsigned int>& input_of_output);
+
+  /**
+   * @brief Get the routing of a preset.
+   * @param index 1-based preset index
+   * @return nullptr if no such preset was stored
+   */
+  const std::vector<unsigned int>* Find(unsigned int index) const;
+
+  std::vector<char> Serialize() const;
+  bool Deserialize(const std::vector<char>& data);
+
+private:
+  std::string path;
+  std::map<unsigned int, std::vector<unsigned int>> presets;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Formatted request held in a fixed buffer without heap allocations.
+ *
+ * Text which does not fit into the buffer is cut off and marks the buffer as
+ * truncated.
+ */
+class RequestBuffer
+{
+public:
+  //! Maximum number of bytes of a request.
+  static const size_t capacity = 128;
+
+  RequestBuffer() = default;
+
+  RequestBuffer(const char* text) { *this << text; }
+
+  RequestBuffer& append(const char* text, size_t size)
+  {
+    const size_t copied = std::min(size, available());
+    memcpy(buffer.data() + length, text, copied);
+    length += copied;
+    is_truncated = is_truncated || copied < size;
+    return *this;
+  }
+
+  RequestBuffer& operator<<(const char* text)
+  {
+    return append(text, strlen(text));
+  }
+
+  RequestBuffer& operator<<(const std::string& text)
+  {
+    return append(text.data(), text.size());
+  }
+
+  RequestBuffer& operator<<(const RequestBuffer& other)
+  {
+    return append(other.data(), other.size());
+  }
+
+  RequestBuffer& operator<<(char c) { return append(&c, 1); }
+
+  RequestBuffer& operator<<(unsigned int value)
+  {
+    const auto result = std::to_chars(
+      buffer.data() + length, buffer.data() + buffer.size(), value);
+    if (result.ec == std::errc()) {
+      length = result.ptr - buffer.data();
+    } else {
+      is_truncated = true;
+    }
+    return *this;
+  }
+
+  const char* data() const { return buffer.data(); }
+
+  size_t size() const { return length; }
+
+  bool empty() const { return length == 0; }
+
+  //! Number of bytes which can still be appended.
+  size_t available() const { return capacity - length; }
+
+  //! Whether some text did not fit into the buffer.
+  bool truncated() const { return is_truncated; }
+
+  std::string str() const { return std::string(data(), size()); }
+
+private:
+  std::array<char, capacity> buffer;
+  size_t length{ 0 };
+  bool is_truncated{ false };
+};
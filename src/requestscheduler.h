@@ -0,0 +1,210 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+//! Classes of requests which share the bandwidth to the device.
+enum class RequestClass
+{
+  //! Requests caused by the user, i.e. ties, presets and name changes.
+  Control = 0,
+  //! Reading the state of the device.
+  Monitoring,
+  //! Reading the names of the inputs and outputs.
+  Names,
+};
+
+/**
+ * @brief Decides which queued request is sent to the device next.
+ *
+ * Each request class has its own queue. The queues are served by a deficit
+ * round robin: every round a class may send as many bytes as its quantum, so
+ * the bandwidth is split by the ratio of the quanta when all classes have
+ * requests. A request which waited longer than the maximum wait of its class
+ * is sent before all others, so background synchronization finishes in
+ * bounded time even under a steady stream of control requests.
+ *
+ * @tparam Request type of the requests, needs a member request whose size()
+ * is the number of bytes sent
+ */
+template<typename Request>
+class RequestScheduler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct ClassPolicy
+  {
+    //! Bytes the class may send per round.
+    size_t quantum;
+    //! Requests waiting longer than this are sent before all others.
+    Clock::duration max_wait;
+  };
+
+  /**
+   * @brief Construct a new instance.
+   * @param capacity number of requests each class can hold until set_capacity
+   * is called
+   */
+  explicit RequestScheduler(size_t capacity = 16)
+    : policies{ { { 128, std::chrono::milliseconds(500) },
+                  { 32, std::chrono::seconds(5) },
+                  { 16, std::chrono::seconds(20) } } }
+  {
+    for (auto& queue : queues)
+      queue.reserve(capacity);
+  }
+
+  void set_policy(RequestClass request_class, const ClassPolicy& policy)
+  {
+    policies[index(request_class)] = policy;
+  }
+
+  //! Allocate room for at least capacity requests of a class. This is the
+  //! only method which allocates, the capacity never shrinks.
+  void set_capacity(RequestClass request_class, size_t capacity)
+  {
+    queues[index(request_class)].reserve(capacity);
+  }
+
+  size_t capacity(RequestClass request_class) const
+  {
+    return queues[index(request_class)].capacity();
+  }
+
+  //! @return false if the queue of the class is full and the request was
+  //! dropped
+  bool push(RequestClass request_class, Request request, Clock::time_point now)
+  {
+    return queues[index(request_class)].push_back({ std::move(request), now });
+  }
+
+  /**
+   * @brief Take the next request to send.
+   * @param[out] request the request to send
+   * @param now current time
+   * @param[out] request_class class of the request
+   * @param[out] waited time the request spent in the queue
+   * @return false if all queues are empty
+   */
+  bool pop(Request& request,
+           Clock::time_point now,
+           RequestClass* request_class = nullptr,
+           Clock::duration* waited = nullptr)
+  {
+    if (empty())
+      return false;
+
+    size_t selected = select_overdue(now);
+
+    while (selected == class_count) {
+      const auto& queue = queues[current];
+      if (queue.empty()) {
+        // An idle class must not save up bandwidth for later.
+        deficits[current] = 0;
+      } else {
+        if (!turn_started) {
+          deficits[current] += policies[current].quantum;
+          turn_started = true;
+        }
+
+        if (queue.front().request.request.size() <= deficits[current]) {
+          selected = current;
+          break;
+        }
+      }
+
+      // Continue with the turn of the next class.
+      current = (current + 1) % class_count;
+      turn_started = false;
+    }
+
+    Entry& entry = queues[selected].front();
+    const size_t size = entry.request.request.size();
+    deficits[selected] =
+      deficits[selected] > size ? deficits[selected] - size : 0;
+
+    if (request_class)
+      *request_class = static_cast<RequestClass>(selected);
+    if (waited)
+      *waited = now - entry.enqueued;
+
+    request = std::move(entry.request);
+    queues[selected].pop_front();
+    return true;
+  }
+
+  void clear(RequestClass request_class)
+  {
+    queues[index(request_class)].clear();
+    deficits[index(request_class)] = 0;
+  }
+
+  //! Drop all requests and start a new round with the control requests.
+  void clear()
+  {
+    for (size_t i = 0; i < class_count; ++i)
+      clear(static_cast<RequestClass>(i));
+    current = 0;
+    turn_started = false;
+  }
+
+  bool empty() const
+  {
+    for (const auto& queue : queues) {
+      if (!queue.empty())
+        return false;
+    }
+    return true;
+  }
+
+  size_t size(RequestClass request_class) const
+  {
+    return queues[index(request_class)].size();
+  }
+
+private:
+  static const size_t class_count = 3;
+
+  struct Entry
+  {
+    Request request;
+    Clock::time_point enqueued;
+  };
+
+  static size_t index(RequestClass request_class)
+  {
+    return static_cast<size_t>(request_class);
+  }
+
+  //! @return the class whose oldest request is most overdue or class_count
+  size_t select_overdue(Clock::time_point now) const
+  {
+    size_t selected = class_count;
+    double most_overdue = 1.0;
+    for (size_t i = 0; i < class_count; ++i) {
+      if (queues[i].empty())
+        continue;
+
+      const double overdue =
+        std::chrono::duration<double>(now - queues[i].front().enqueued) /
+        std::chrono::duration<double>(policies[i].max_wait);
+      if (overdue > most_overdue) {
+        most_overdue = overdue;
+        selected = i;
+      }
+    }
+    return selected;
+  }
+
+  std::array<RingBuffer<Entry>, class_count> queues;
+  std::array<ClassPolicy, class_count> policies;
+  std::array<size_t, class_count> deficits{};
+  //! Class whose turn it is.
+  size_t current{ 0 };
+  //! Whether the class whose turn it is already got its quantum.
+  bool turn_started{ false };
+};
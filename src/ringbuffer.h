@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief FIFO queue in a contiguous ring with a fixed capacity.
+ *
+ * Unlike std::deque, pushing and popping never allocates. Only reserve()
+ * allocates, so memory use stays flat once the capacity is set.
+ */
+template<typename T>
+class RingBuffer
+{
+public:
+  bool empty() const { return count == 0; }
+
+  size_t size() const { return count; }
+
+  size_t capacity() const { return storage.size(); }
+
+  //! Grow the ring so it can hold at least new_capacity elements. Keeps the
+  //! queued elements.
+  void reserve(size_t new_capacity)
+  {
+    if (new_capacity <= storage.size())
+      return;
+
+    std::vector<T> new_storage(new_capacity);
+    for (size_t i = 0; i < count; ++i) {
+      new_storage[i] = std::move(storage[(head + i) % storage.size()]);
+    }
+    storage = std::move(new_storage);
+    head = 0;
+  }
+
+  //! @return false if the ring is full and value was not added
+  bool push_back(T value)
+  {
+    if (count == storage.size())
+      return false;
+
+    storage[(head + count) % storage.size()] = std::move(value);
+    ++count;
+    return true;
+  }
+
+  T& front() { return storage[head]; }
+
+  const T& front() const { return storage[head]; }
+
+  void pop_front()
+  {
+    head = (head + 1) % storage.size();
+    --count;
+  }
+
+  void clear()
+  {
+    head = 0;
+    count = 0;
+  }
+
+private:
+  std::vector<T> storage;
+  //! Index of the first element.
+  size_t head{ 0 };
+  //! Number of elements in the ring.
+  size_t count{ 0 };
+};
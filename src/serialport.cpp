@@ -0,0 +1,50 @@
+#include "serialport.h"
+
+SerialPort::SerialPort(boost::asio::io_service& io_service)
+  : port(io_service)
+{}
+
+void SerialPort::open(const std::string& port_name, unsigned int baud_rate)
+{
+  port.open(port_name);
+
+  set_baud_rate(baud_rate);
+  port.set_option(boost::asio::serial_port_base::character_size(8));
+  port.set_option(boost::asio::serial_port_base::stop_bits(
+    boost::asio::serial_port_base::stop_bits::one));
+  port.set_option(boost::asio::serial_port_base::parity(
+    boost::asio::serial_port_base::parity::none));
+  port.set_option(boost::asio::serial_port_base::flow_control(
+    boost::asio::serial_port_base::flow_control::none));
+}
+
+void SerialPort::set_baud_rate(unsigned int baud_rate)
+{
+  port.set_option(boost::asio::serial_port_base::baud_rate(baud_rate));
+}
+
+void SerialPort::close()
+{
+  port.close();
+}
+
+bool SerialPort::is_open() const
+{
+  return port.is_open();
+}
+
+void SerialPort::write(const char* data, std::size_t size)
+{
+  boost::asio::write(port, boost::asio::buffer(data, size));
+}
+
+void SerialPort::async_read_some(const boost::asio::mutable_buffer& buffer,
+                                 ReadHandler handler)
+{
+  port.async_read_some(buffer, std::move(handler));
+}
+
+boost::asio::serial_port::executor_type SerialPort::get_executor()
+{
+  return port.get_executor();
+}
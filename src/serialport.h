@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/asio/serial_port.hpp>
+
+/**
+ * @brief Serial port configured for Extron matrices.
+ *
+ * Thin wrapper around boost::asio::serial_port so the tests can exchange the
+ * implementation at link time for one which talks to an emulated device.
+ */
+class SerialPort
+{
+public:
+  using ReadHandler =
+    std::function<void(const boost::system::error_code& ec,
+                       std::size_t bytes_transferred)>;
+
+  explicit SerialPort(boost::asio::io_service& io_service);
+
+  /**
+   * @brief Open the port with 8 data bits, 1 stop bit and without parity or
+   * flow control.
+   * @param port_name Path to the serial port, i.e. /dev/ttyUSB0.
+   * @param baud_rate Bits per second.
+   */
+  void open(const std::string& port_name, unsigned int baud_rate = 9600);
+
+  //! Change the bits per second of the open port.
+  void set_baud_rate(unsigned int baud_rate);
+
+  void close();
+
+  bool is_open() const;
+
+  //! Write all bytes, blocking until they are sent.
+  void write(const char* data, std::size_t size);
+
+  //! Read some bytes asynchronously into buffer.
+  void async_read_some(const boost::asio::mutable_buffer& buffer,
+                       ReadHandler handler);
+
+  //! Executor of the io service the port runs on.
+  boost::asio::serial_port::executor_type get_executor();
+
+private:
+  boost::asio::serial_port port;
+};
@@ -0,0 +1,151 @@
+#include "serialportdiscovery.h"
+
+#include <algorithm>
+#include <future>
+#include <regex>
+#include <thread>
+
+#include <boost/asio.hpp>
+
+#include "listserialports.h"
+#include "serialport.h"
+
+namespace {
+//! The dimensions in the answer to I, see Device for the whole response.
+const std::regex information(
+  "^I[0-9]{2,3}X[0-9]{2,3} .* M([0-9]{2,3})X([0-9]{2,3}) .*$");
+}
+
+const std::chrono::milliseconds SerialPortDiscovery::probe_timeout(500);
+
+SerialPortDiscovery::SerialPortDiscovery(Lister lister, Prober prober)
+  : lister(lister ? std::move(lister) : listSerialPorts)
+  , prober(prober ? std::move(prober) : ProbeSerialPort)
+{}
+
+SerialPortDiscovery::~SerialPortDiscovery()
+{
+  Wait();
+}
+
+bool SerialPortDiscovery::Start(bool probe,
+                                unsigned int baud_rate,
+                                std::function<void()> done)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+      return false;
+    running = true;
+  }
+  // The previous discovery has ended, only its thread is left to join.
+  if (worker.joinable())
+    worker.join();
+
+  worker = std::thread([this, probe, baud_rate, done = std::move(done)]() {
+    std::vector<Port> found;
+    for (std::string& name : lister())
+      found.push_back({ std::move(name) });
+
+    if (probe) {
+      // Each probe mostly waits for its port, so they all wait at once. The
+      // futures are waited for before the thread ends.
+      std::vector<std::future<bool>> probes;
+      for (Port& port : found)
+        probes.push_back(
+          std::async(std::launch::async, [this, &port, baud_rate]() {
+            return prober(port, baud_rate);
+          }));
+      for (size_t i = 0; i < found.size(); ++i)
+        found[i].matrix = probes[i].get();
+    } else {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (Port& port : found) {
+        const auto known =
+          std::find_if(ports.begin(), ports.end(), [&port](const Port& p) {
+            return p.name == port.name;
+          });
+        if (known != ports.end())
+          port = *known;
+      }
+    }
+
+    std::stable_partition(found.begin(), found.end(), [](const Port& port) {
+      return port.matrix;
+    });
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ports = std::move(found);
+    }
+
+    if (done)
+      done();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  });
+  return true;
+}
+
+std::vector<SerialPortDiscovery::Port> SerialPortDiscovery::GetPorts() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return ports;
+}
+
+void SerialPortDiscovery::Wait()
+{
+  if (worker.joinable())
+    worker.join();
+}
+
+bool ProbeSerialPort(SerialPortDiscovery::Port& port, unsigned int baud_rate)
+{
+  boost::asio::io_service io_service;
+  SerialPort serial_port(io_service);
+  try {
+    serial_port.open(port.name, baud_rate);
+  } catch (const boost::system::system_error&) {
+    return false;
+  }
+
+  std::string response;
+  char buffer[64];
+  bool answered = false;
+  boost::asio::steady_timer timeout(io_service,
+                                    SerialPortDiscovery::probe_timeout);
+  std::function<void(const boost::system::error_code&, std::size_t)> read =
+    [&](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+      if (ec) {
+        timeout.cancel();
+        return;
+      }
+      response.append(buffer, bytes_transferred);
+      const size_t line_end = response.find("\r\n");
+      if (line_end == std::string::npos) {
+        serial_port.async_read_some(boost::asio::buffer(buffer), read);
+        return;
+      }
+
+      std::smatch m;
+      const std::string line = response.substr(0, line_end);
+      if (std::regex_match(line, m, information)) {
+        port.inputs = std::stoul(m.str(1));
+        port.outputs = std::stoul(m.str(2));
+        answered = true;
+      }
+      timeout.cancel();
+    };
+
+  serial_port.async_read_some(boost::asio::buffer(buffer), read);
+  serial_port.write("I", 1);
+  timeout.async_wait([&](const boost::system::error_code& ec) {
+    if (!ec)
+      io_service.stop();
+  });
+  io_service.run();
+
+  serial_port.close();
+  return answered;
+}
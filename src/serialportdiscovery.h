@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Finds the serial ports and the Extron matrices attached to them.
+ *
+ * A discovery lists the ports of the platform and, only if asked to, asks all
+ * of them at the same time for the information of a matrix, so it takes one
+ * probe timeout no matter how many ports there are. It runs in the background
+ * and its result is kept, so the configuration dialog can show the ports of
+ * the previous discovery right away. A discovery without probes keeps what
+ * earlier probes found out about the ports which are still there.
+ */
+class SerialPortDiscovery
+{
+public:
+  struct Port
+  {
+    //! Name to open the port with, i.e. COM3 or /dev/ttyUSB0.
+    std::string name;
+    //! Whether a matrix answered the probe.
+    bool matrix{ false };
+    //! Number of virtual inputs of the matrix.
+    unsigned int inputs{ 0 };
+    //! Number of virtual outputs of the matrix.
+    unsigned int outputs{ 0 };
+  };
+
+  //! Lists the names of the candidate ports.
+  using Lister = std::function<std::vector<std::string>()>;
+  //! Asks a port for a matrix with the given baud rate and fills in its
+  //! dimensions. Returns whether a matrix answered.
+  using Prober = std::function<bool(Port& port, unsigned int baud_rate)>;
+
+  /**
+   * @param lister lists the ports, the ports of the platform by default
+   * @param prober probes a port, sends I by default
+   */
+  explicit SerialPortDiscovery(Lister lister = nullptr,
+                               Prober prober = nullptr);
+
+  //! Waits for a running discovery.
+  ~SerialPortDiscovery();
+
+  /**
+   * @brief Discover the ports in the background unless a discovery is already
+   * running.
+   *
+   * Probing writes to every serial port of the computer, which may disturb
+   * other devices, so it should only be done when the user asks for it.
+   * @param probe whether to ask each port for a matrix
+   * @param baud_rate bits per second to probe the ports with
+   * @param done called from the background thread once the ports of this
+   * discovery are available
+   * @return false if a discovery is already running
+   */
+  bool Start(bool probe,
+             unsigned int baud_rate = 9600,
+             std::function<void()> done = nullptr);
+
+  //! Ports found by the last completed discovery, the matrices first.
+  std::vector<Port> GetPorts() const;
+
+  /**
+   * @brief Block until the background thread and all of its probes ended.
+   *
+   * Must be called from the thread which starts the discoveries, before the
+   * code of the discovery may be unloaded.
+   */
+  void Wait();
+
+  //! Time a port is given to answer the probe.
+  static const std::chrono::milliseconds probe_timeout;
+
+private:
+  Lister lister;
+  Prober prober;
+  //! Runs the discovery and waits for its probes.
+  std::thread worker;
+  mutable std::mutex mutex;
+  bool running{ false };
+  std::vector<Port> ports;
+};
+
+/**
+ * @brief Send I to a port and wait for the information of a matrix.
+ * @param baud_rate bits per second to open the port with
+ * @return false if the port cannot be opened or nothing answered within
+ * SerialPortDiscovery::probe_timeout
+ */
+bool ProbeSerialPort(SerialPortDiscovery::Port& port,
+                     unsigned int baud_rate = 9600);
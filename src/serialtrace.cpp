@@ -0,0 +1,206 @@
+#include "serialtrace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+const char magic[8] = { 'E', 'X', 'M', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t version = 1;
+//! Kind of a slot which continues the data of the previous one.
+const uint8_t continuation = 3;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t slot_size;
+  uint64_t slot_count;
+  char reserved[40];
+};
+
+struct SlotHeader
+{
+  uint64_t sequence;
+  int64_t time;
+  //! 0 for an unused slot, a Kind or continuation.
+  uint8_t kind;
+  uint8_t type;
+  //! Size of the whole event in its first slot, else of the slot's data.
+  uint16_t size;
+  uint32_t request;
+};
+
+static_assert(sizeof(FileHeader) == SerialTrace::slot_size,
+              "The header fills exactly one slot.");
+static_assert(sizeof(SlotHeader) + SerialTrace::payload_size ==
+                SerialTrace::slot_size,
+              "The data fills the rest of a slot.");
+} // namespace
+
+const size_t SerialTrace::slot_size;
+const size_t SerialTrace::payload_size;
+const size_t SerialTrace::max_event_size;
+const size_t SerialTrace::default_slot_count;
+
+SerialTrace::SerialTrace(const std::string& path)
+  : path(path)
+{}
+
+bool SerialTrace::open(size_t slot_count)
+{
+  namespace ipc = boost::interprocess;
+
+  if (slot_count * payload_size < 2 * max_event_size)
+    return false;
+
+  const size_t file_size = (slot_count + 1) * slot_size;
+  {
+    std::filebuf file;
+    if (!file.open(path,
+                   std::ios::in | std::ios::out | std::ios::trunc |
+                     std::ios::binary))
+      return false;
+    if (file.pubseekoff(file_size - 1, std::ios::beg) < 0 ||
+        file.sputc(0) == std::filebuf::traits_type::eof())
+      return false;
+  }
+
+  try {
+    mapping = ipc::file_mapping(path.c_str(), ipc::read_write);
+    region = ipc::mapped_region(mapping, ipc::read_write, 0, file_size);
+  } catch (const ipc::interprocess_exception&) {
+    return false;
+  }
+
+  // Touch every page now, so recording does not fault them in later.
+  char* base = static_cast<char*>(region.get_address());
+  memset(base, 0, file_size);
+
+  FileHeader header{};
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.slot_size = slot_size;
+  header.slot_count = slot_count;
+  memcpy(base, &header, sizeof(header));
+
+  slots = base + slot_size;
+  this->slot_count = slot_count;
+  start = Clock::now();
+  next_sequence = 0;
+  return true;
+}
+
+bool SerialTrace::is_open() const
+{
+  return slots != nullptr;
+}
+
+void SerialTrace::record(Kind kind,
+                         uint8_t type,
+                         uint32_t request,
+                         const char* data,
+                         size_t size,
+                         Clock::time_point time)
+{
+  size = std::min(size, max_event_size);
+  const size_t count =
+    size == 0 ? 1 : (size + payload_size - 1) / payload_size;
+  const uint64_t first =
+    next_sequence.fetch_add(count, std::memory_order_relaxed);
+  const int64_t nanoseconds =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(time - start)
+      .count();
+
+  for (size_t i = 0; i < count; ++i) {
+    const uint64_t sequence = first + i;
+    const size_t offset = i * payload_size;
+    const size_t chunk = std::min(payload_size, size - offset);
+
+    SlotHeader header{};
+    header.sequence = sequence;
+    header.time = nanoseconds;
+    header.kind = i == 0 ? static_cast<uint8_t>(kind) : continuation;
+    header.type = type;
+    header.request = request;
+    header.size = static_cast<uint16_t>(i == 0 ? size : chunk);
+
+    char* slot = slots + (sequence % slot_count) * slot_size;
+    memcpy(slot, &header, sizeof(header));
+    if (chunk > 0)
+      memcpy(slot + sizeof(header), data + offset, chunk);
+  }
+}
+
+bool SerialTrace::read(const std::string& path, std::vector<Event>& events)
+{
+  events.clear();
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  const std::vector<char> data{ std::istreambuf_iterator<char>(file),
+                                std::istreambuf_iterator<char>() };
+
+  FileHeader header;
+  if (data.size() < sizeof(header))
+    return false;
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != version || header.slot_size != slot_size ||
+      data.size() < (header.slot_count + 1) * slot_size)
+    return false;
+
+  const size_t slot_count = static_cast<size_t>(header.slot_count);
+  auto slot_header = [&data](size_t index) {
+    SlotHeader slot;
+    memcpy(&slot, data.data() + (index + 1) * slot_size, sizeof(slot));
+    return slot;
+  };
+
+  // The newest slot has the highest sequence number, the oldest one still in
+  // the ring is a whole ring before it.
+  bool empty = true;
+  uint64_t last = 0;
+  for (size_t i = 0; i < slot_count; ++i) {
+    const SlotHeader slot = slot_header(i);
+    if (slot.kind != 0 && (empty || slot.sequence > last)) {
+      last = slot.sequence;
+      empty = false;
+    }
+  }
+  if (empty)
+    return true;
+
+  const uint64_t first = last + 1 > slot_count ? last + 1 - slot_count : 0;
+  Event* event = nullptr;
+  size_t missing = 0;
+  for (uint64_t sequence = first; sequence <= last; ++sequence) {
+    const size_t index = static_cast<size_t>(sequence % slot_count);
+    const SlotHeader slot = slot_header(index);
+    const char* payload =
+      data.data() + (index + 1) * slot_size + sizeof(SlotHeader);
+
+    if (slot.kind == 0 || slot.sequence != sequence) {
+      event = nullptr;
+    } else if (slot.kind == continuation) {
+      // Skip the rest of an event whose beginning was overwritten.
+      if (event == nullptr || missing == 0)
+        continue;
+      const size_t chunk = std::min<size_t>(slot.size, missing);
+      event->data.append(payload, chunk);
+      missing -= chunk;
+    } else {
+      const size_t chunk = std::min<size_t>(slot.size, payload_size);
+      events.push_back({ slot.time,
+                         static_cast<Kind>(slot.kind),
+                         slot.type,
+                         slot.request,
+                         std::string(payload, chunk) });
+      event = &events.back();
+      missing = slot.size - chunk;
+    }
+  }
+  return true;
+}
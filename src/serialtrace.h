@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "steadyclock.h"
+
+/**
+ * @brief Records the serial communication and the lifecycle of the requests
+ * into a memory-mapped ring file.
+ *
+ * The file gets its full size and is mapped when opening, so recording an
+ * event only copies it into memory and never waits for the disk. When the
+ * ring is full, the oldest events are overwritten.
+ *
+ * The file starts with a header of one slot followed by the ring of slots.
+ * Each slot holds the sequence number, the time, the kind and the request of
+ * the event and up to payload_size bytes of data. Longer events continue in
+ * the following slots.
+ */
+class SerialTrace
+{
+public:
+  using Clock = SteadyClock;
+
+  enum class Kind : uint8_t
+  {
+    //! A request was written, the data is the request.
+    Sent = 1,
+    //! A line was received, the data is the line without \r\n.
+    Received = 2,
+    // 3 marks the continuation of an event in the file.
+    //! A request was queued, the data is the request.
+    Enqueued = 4,
+    //! A request became the request in progress.
+    Promoted = 5,
+    //! The first byte of a line was received.
+    FirstByte = 6,
+    //! The response to a request was complete. The data is empty or the
+    //! reason why the request failed without response.
+    Completed = 7,
+    //! A simulation step began, the request is the number of the step.
+    StepBegin = 8,
+    //! A simulation step ended, the request is the number of the step.
+    StepEnd = 9,
+  };
+
+  struct Event
+  {
+    //! Nanoseconds since the trace was opened.
+    int64_t time;
+    Kind kind;
+    //! Device::RequestType of the request.
+    uint8_t type;
+    //! Number of the request, which identifies the events of one request.
+    uint32_t request;
+    std::string data;
+  };
+
+  //! Bytes of a slot in the file.
+  static const size_t slot_size = 64;
+  //! Bytes of data in a slot.
+  static const size_t payload_size = 40;
+  //! Longer events are truncated.
+  static const size_t max_event_size = 1024;
+  //! 4 MiB, about 65000 requests and responses.
+  static const size_t default_slot_count = 65536;
+
+  /**
+   * @brief Construct a closed trace.
+   * @param path file the events are recorded into
+   */
+  explicit SerialTrace(const std::string& path);
+
+  /**
+   * @brief Create the file, replacing an existing one, and map it.
+   * @param slot_count number of slots in the ring, at least 64
+   * @return false if the file could not be created or mapped
+   */
+  bool open(size_t slot_count = default_slot_count);
+
+  bool is_open() const;
+
+  /**
+   * @brief Record an event. May be called from several threads at once.
+   * @param kind what happened
+   * @param type type of the request
+   * @param request number of the request
+   * @param time when the event happened
+   */
+  void record(Kind kind,
+              uint8_t type,
+              uint32_t request,
+              const char* data,
+              size_t size,
+              Clock::time_point time);
+
+  /**
+   * @brief Read the events still in a trace file, oldest first.
+   * @return false if the file could not be read or is no trace
+   */
+  static bool read(const std::string& path, std::vector<Event>& events);
+
+private:
+  std::string path;
+  boost::interprocess::file_mapping mapping;
+  boost::interprocess::mapped_region region;
+  //! First slot of the ring in the mapping.
+  char* slots = nullptr;
+  size_t slot_count = 0;
+  Clock::time_point start;
+  //! Sequence number of the next slot to write.
+  std::atomic<uint64_t> next_sequence{ 0 };
+};
@@ -1,6 +1,9 @@
 #include "simulation.h"
 
 #include <boost/algorithm/string/find.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <cstring>
 
 namespace {
@@ -8,8 +11,36 @@ unsigned int normalizeToUnsignedInt(double value)
 {
   return static_cast<unsigned int>(value);
 }
+
+//! Number of milliseconds in a duration.
+double Milliseconds(std::chrono::microseconds duration)
+{
+  return duration.count() / 1000.0;
+}
+
+//! Longest name which is kept without allocating.
+const size_t reservedNameLength = RequestBuffer::capacity;
+
+//! Characters of an output in the $MAP pins.
+const size_t mapEntrySize = 2;
+
+//! Replace previous with the text if they differ.
+//! @return whether previous changed
+bool AssignIfChanged(std::string& previous, const char* text, size_t size)
+{
+  if (previous.size() == size && previous.compare(0, size, text, size) == 0)
+    return false;
+
+  previous.assign(text, size);
+  return true;
+}
 }
 
+const std::array<const char*, Configuration::statistics_pin_count>
+  Simulation::StatisticsPinNames{
+  { "SENT", "ERRORS", "TIMEOUTS", "QUEUE", "RTT50", "RTT99" }
+};
+
 Simulation::Simulation(const Configuration& configuration)
   : configuration(configuration)
 {
@@ -20,12 +51,55 @@ Simulation::Simulation(const Configuration& configuration)
 
   previousInputNames.clear();
   previousInputNames.resize(configuration.inputs);
+  for (std::string& name : previousInputNames)
+    name.reserve(reservedNameLength);
 
   previousOutputNames.clear();
   previousOutputNames.resize(configuration.outputs);
+  for (std::string& name : previousOutputNames)
+    name.reserve(reservedNameLength);
+
+  stagedInputOfOutput.clear();
+  stagedInputOfOutput.resize(configuration.outputs, 0);
+
+  confirmedInputOfOutput.clear();
+  confirmedInputOfOutput.resize(configuration.outputs, 0);
+
+  pendingTies.clear();
+  pendingTies.resize(configuration.outputs, 0);
+
+  shownInputOfOutput.clear();
+  shownInputOfOutput.resize(configuration.outputs, 0);
+
+  previousMap.clear();
+  previousMap.reserve(mapEntrySize * configuration.outputs);
+  mapInputOfOutput.clear();
+  mapInputOfOutput.resize(configuration.outputs, 0);
+  nextMap = std::string(mapEntrySize * configuration.outputs, '0');
+  routingGeneration = 0;
+  encodedGeneration = 0;
+
+  pendingPinIndex = 3 + configuration.RoutingPins();
+  if (configuration.includeInputNames)
+    pendingPinIndex += 1;
+  if (configuration.includeOutputNames)
+    pendingPinIndex += 1;
+
+  statisticsPinIndex = pendingPinIndex;
+  if (configuration.optimisticTies)
+    statisticsPinIndex += 1;
+
+  tallyPinIndex = statisticsPinIndex;
+  if (configuration.statisticsPins)
+    tallyPinIndex += Configuration::statistics_pin_count;
+
+  tallyOfInput.clear();
+  tallyOfInput.resize(configuration.inputs, 0.0);
 
   nextPOutput.clear();
-  nextPOutput.resize(3 + configuration.outputs, 0.0);
+  nextPOutput.resize(configuration.optimisticTies ? pendingPinIndex + 1
+                                                 : pendingPinIndex,
+                     0.0);
   nextPOutputSizeInBytes = nextPOutput.size() * sizeof(double);
 
   nextInputNames = std::string(configuration.inputs - 1, ';');
@@ -33,17 +107,36 @@ Simulation::Simulation(const Configuration& configuration)
 
   errorMessage = "";
 
+  if (!configuration.presetFile.empty()) {
+    presetLibrary = std::make_unique<PresetLibrary>(configuration.presetFile);
+    if (!presetLibrary->Load()) {
+      nextPOutput[1] = 5.0;
+      errorMessage =
+        "Unable to read the presets from " + configuration.presetFile + ".";
+    }
+  }
+
+  if (!configuration.traceFile.empty()) {
+    trace = std::make_unique<SerialTrace>(configuration.traceFile);
+    if (!trace->open()) {
+      nextPOutput[1] = 5.0;
+      errorMessage =
+        "Unable to create the trace " + configuration.traceFile + ".";
+      trace.reset();
+    }
+  }
+
   work = std::make_unique<boost::asio::io_service::work>(io_service);
   thread = std::make_unique<std::thread>([this]() { io_service.run(); });
 
   device = std::make_unique<Device>(io_service);
   try {
     device->connectedCallback = [this]() {
-      std::unique_lock<std::mutex>(mutex);
+      std::lock_guard<std::mutex> lock(mutex);
       nextPOutput[0] = 5.0;
     };
     device->setupCallback = [this, configuration]() {
-      std::unique_lock<std::mutex>(mutex);
+      std::lock_guard<std::mutex> lock(mutex);
       std::ostringstream str;
       if (device->get_number_of_virtual_outputs() != configuration.outputs)
         str << "Device has "
@@ -64,13 +157,40 @@ Simulation::Simulation(const Configuration& configuration)
         canCommunicate = true;
       }
     };
-    device->tieChanged = [this](uint8_t out, uint8_t in) {
-      std::unique_lock<std::mutex>(mutex);
-      nextPOutput[3 + out - 1] = in;
+    device->tieChanged = [this](uint16_t out, uint16_t in) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (out > this->configuration.outputs)
+        return;
+
+      const unsigned int previousInput = confirmedInputOfOutput[out - 1];
+      confirmedInputOfOutput[out - 1] = in;
+      if (this->configuration.tallyPins) {
+        UpdateTallyPin(previousInput);
+        UpdateTallyPin(in);
+      }
+      if (pendingTies[out - 1] > 0) {
+        --pendingTies[out - 1];
+        UpdatePendingPin();
+      }
+
+      // Keep showing a newer requested tie until it is confirmed, too.
+      if (pendingTies[out - 1] == 0)
+        ShowInput(out - 1, in);
+    };
+    device->tieFailed = [this](uint16_t out) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (out > this->configuration.outputs || pendingTies[out - 1] == 0)
+        return;
+
+      --pendingTies[out - 1];
+      UpdatePendingPin();
+
+      if (pendingTies[out - 1] == 0)
+        ShowInput(out - 1, confirmedInputOfOutput[out - 1]);
     };
-    device->inputNameChanged = [this](uint8_t channel,
+    device->inputNameChanged = [this](uint16_t channel,
                                       const std::string& name) {
-      std::unique_lock<std::mutex>(mutex);
+      std::lock_guard<std::mutex> lock(mutex);
       auto begin = channel == 1 ? nextInputNames.begin()
                                 : std::next(boost::algorithm::find_nth(
                                               nextInputNames, ";", channel - 2)
@@ -79,9 +199,9 @@ Simulation::Simulation(const Configuration& configuration)
         boost::algorithm::find_nth(nextInputNames, ";", channel - 1).end());
       nextInputNames.replace(begin, end, name);
     };
-    device->outputNameChanged = [this](uint8_t channel,
+    device->outputNameChanged = [this](uint16_t channel,
                                        const std::string& name) {
-      std::unique_lock<std::mutex>(mutex);
+      std::lock_guard<std::mutex> lock(mutex);
       auto begin = channel == 1 ? nextOutputNames.begin()
                                 : std::next(boost::algorithm::find_nth(
                                               nextOutputNames, ";", channel - 2)
@@ -91,11 +211,22 @@ Simulation::Simulation(const Configuration& configuration)
       nextOutputNames.replace(begin, end, name);
     };
     device->reportError = [this](const std::string& message) {
-      std::unique_lock<std::mutex>(mutex);
+      std::lock_guard<std::mutex> lock(mutex);
       nextPOutput[1] = 5.0;
       errorMessage = message;
     };
-    device->open(configuration.comPort);
+    if (trace)
+      device->set_trace(trace.get());
+    device->set_synchronized_names(
+      static_cast<uint16_t>(
+        configuration.includeInputNames ? configuration.inputs : 0),
+      static_cast<uint16_t>(
+        configuration.includeOutputNames ? configuration.outputs : 0));
+    device->set_name_verification(
+      static_cast<Device::NameVerification>(configuration.nameVerification));
+    device->open(configuration.comPort,
+                 configuration.baudRate,
+                 configuration.negotiateBaudRate);
   } catch (const boost::system::system_error& e) {
     nextPOutput[1] = 5.0;
     errorMessage = e.what();
@@ -112,9 +243,196 @@ Simulation::~Simulation()
   device.reset();
 }
 
+void Simulation::StoreHostPreset(unsigned int index)
+{
+  presetLibrary->Store(index, confirmedInputOfOutput);
+  if (!presetLibrary->Save()) {
+    nextPOutput[1] = 5.0;
+    errorMessage =
+      "Unable to write the presets to " + configuration.presetFile + ".";
+  }
+}
+
+void Simulation::RecallHostPreset(unsigned int index)
+{
+  const std::vector<unsigned int>* inputOfOutput = presetLibrary->Find(index);
+  if (inputOfOutput == nullptr) {
+    nextPOutput[1] = 5.0;
+    errorMessage = "Preset " + std::to_string(index) + " is not stored.";
+    return;
+  }
+
+  TieMultiple(*inputOfOutput);
+}
+
+void Simulation::Tie(unsigned int input, unsigned int output)
+{
+  if (configuration.optimisticTies) {
+    ShowInput(output - 1, input);
+    ++pendingTies[output - 1];
+    UpdatePendingPin();
+  }
+
+  device->tie(input, output);
+}
+
+void Simulation::TieMultiple(const std::vector<unsigned int>& inputOfOutput)
+{
+  if (configuration.optimisticTies) {
+    // Device only sends the ties which change the routing.
+    for (size_t i = 0; i < inputOfOutput.size() && i < configuration.outputs;
+         ++i) {
+      if (inputOfOutput[i] != confirmedInputOfOutput[i]) {
+        ShowInput(i, inputOfOutput[i]);
+        ++pendingTies[i];
+      }
+    }
+    UpdatePendingPin();
+  }
+
+  device->tie_multiple(inputOfOutput);
+}
+
+unsigned int Simulation::InputOfPin(const double* pins, size_t output) const
+{
+  if (!configuration.compactPins)
+    return normalizeToUnsignedInt(pins[output]);
+
+  // The first output of a pin is in the lowest digits.
+  const uint64_t packed = static_cast<uint64_t>(
+    pins[output / Configuration::outputs_per_compact_pin]);
+  uint64_t divisor = 1;
+  for (size_t i = 0; i < output % Configuration::outputs_per_compact_pin; ++i)
+    divisor *= 1000;
+  return static_cast<unsigned int>(packed / divisor % 1000);
+}
+
+void Simulation::ShowInput(size_t output, unsigned int input)
+{
+  if (!configuration.compactPins && !configuration.mapPins) {
+    nextPOutput[3 + output] = input;
+    return;
+  }
+
+  if (shownInputOfOutput[output] == input)
+    return;
+  shownInputOfOutput[output] = input;
+  if (configuration.mapPins) {
+    ++routingGeneration;
+    return;
+  }
+
+  const size_t pin = output / Configuration::outputs_per_compact_pin;
+  const size_t first = pin * Configuration::outputs_per_compact_pin;
+  const size_t end = std::min<size_t>(
+    first + Configuration::outputs_per_compact_pin, shownInputOfOutput.size());
+  double packed = 0.0;
+  for (size_t i = end; i-- > first;)
+    packed = packed * 1000 + shownInputOfOutput[i];
+  nextPOutput[3 + pin] = packed;
+}
+
+void Simulation::ReadMapPin(const char* map)
+{
+  const size_t size =
+    strnlen(map, mapEntrySize * configuration.outputs) / mapEntrySize *
+    mapEntrySize;
+  // Usually nothing changed, which a single comparison finds out.
+  if (size == previousMap.size() &&
+      memcmp(map, previousMap.data(), size) == 0)
+    return;
+
+  // Outputs whose entry did not change keep the confirmed routing, so only
+  // the changed ones are sent.
+  mapInputOfOutput = confirmedInputOfOutput;
+  bool changed = false;
+  for (size_t i = 0; i < size; i += mapEntrySize) {
+    if (i < previousMap.size() &&
+        memcmp(map + i, previousMap.data() + i, mapEntrySize) == 0)
+      continue;
+
+    unsigned int input;
+    const char* const end = map + i + mapEntrySize;
+    const auto result = std::from_chars(map + i, end, input, 16);
+    if (result.ec != std::errc() || result.ptr != end)
+      continue;
+
+    const size_t output = i / mapEntrySize;
+    if (configuration.stagedRouting) {
+      stagedInputOfOutput[output] = input;
+    } else {
+      mapInputOfOutput[output] = input;
+      changed = true;
+    }
+  }
+  previousMap.assign(map, size);
+
+  if (changed)
+    TieMultiple(mapInputOfOutput);
+}
+
+void Simulation::WriteMapPin(char* map)
+{
+  if (encodedGeneration != routingGeneration) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < shownInputOfOutput.size(); ++i) {
+      const unsigned int input = shownInputOfOutput[i];
+      nextMap[mapEntrySize * i] = digits[input >> 4 & 0xF];
+      nextMap[mapEntrySize * i + 1] = digits[input & 0xF];
+    }
+    encodedGeneration = routingGeneration;
+  }
+
+  memcpy(map, nextMap.c_str(), nextMap.size() + 1);
+}
+
+void Simulation::UpdatePendingPin()
+{
+  if (!configuration.optimisticTies)
+    return;
+
+  // A double holds integers exactly up to 2^53, so only the first 53 outputs
+  // can be represented in the bit mask.
+  double mask = 0.0;
+  for (size_t i = 0; i < pendingTies.size() && i < 53; ++i) {
+    if (pendingTies[i] > 0)
+      mask += std::ldexp(1.0, static_cast<int>(i));
+  }
+  nextPOutput[pendingPinIndex] = mask;
+}
+
+void Simulation::UpdateTallyPin(unsigned int input)
+{
+  if (input == 0 || input > tallyOfInput.size())
+    return;
+
+  tallyOfInput[input - 1] =
+    device->count_outputs_of_input(static_cast<uint16_t>(input));
+}
+
+void Simulation::WriteStatisticsPins(double* POutput) const
+{
+  const DeviceStatistics& statistics = device->get_statistics();
+  double* pins = POutput + statisticsPinIndex;
+  pins[0] = static_cast<double>(statistics.get_requests());
+  pins[1] = static_cast<double>(statistics.get_errors());
+  pins[2] = static_cast<double>(statistics.get_timeouts());
+  pins[3] = static_cast<double>(statistics.get_queue_depth());
+  pins[4] = Milliseconds(statistics.get_round_trip(0.5));
+  pins[5] = Milliseconds(statistics.get_round_trip(0.99));
+}
+
 void Simulation::Calculate(double* PInput, double* POutput, char** PStrings)
 {
-  std::unique_lock<std::mutex>(mutex);
+  if (trace)
+    trace->record(SerialTrace::Kind::StepBegin,
+                  0,
+                  ++step,
+                  nullptr,
+                  0,
+                  SerialTrace::Clock::now());
+
+  std::lock_guard<std::mutex> lock(mutex);
   // We assume that PUser is the same as in the other calls. Therefore it's not
   // parsed every simulation step but the previously parsed configuration is
   // used.
@@ -126,8 +444,12 @@ void Simulation::Calculate(double* PInput, double* POutput, char** PStrings)
       if (previousNormalizedPInput[0] != normalizedStore) {
         previousNormalizedPInput[0] = normalizedStore;
 
-        if (normalizedStore != 0)
-          device->store(normalizedStore);
+        if (normalizedStore != 0) {
+          if (presetLibrary)
+            StoreHostPreset(normalizedStore);
+          else
+            device->store(normalizedStore);
+        }
       }
     }
 
@@ -137,24 +459,34 @@ void Simulation::Calculate(double* PInput, double* POutput, char** PStrings)
       if (previousNormalizedPInput[1] != normalizedRecall) {
         previousNormalizedPInput[1] = normalizedRecall;
 
-        if (normalizedRecall != 0)
-          device->recall(normalizedRecall);
+        if (normalizedRecall != 0) {
+          if (presetLibrary)
+            RecallHostPreset(normalizedRecall);
+          else
+            device->recall(normalizedRecall);
+        }
       }
     }
 
     size_t offset = 2; // store and recall from above
 
-    for (unsigned int i = 0; i < configuration.outputs; i++) {
-      const unsigned int normalizedValue =
-        normalizeToUnsignedInt(PInput[offset + i]);
-      if (previousNormalizedPInput[offset + i] != normalizedValue) {
-        previousNormalizedPInput[offset + i] = normalizedValue;
-        device->tie(normalizedValue,
-                    i + 1); // i is 0-based but device parameters are 1-based
+    if (configuration.mapPins) {
+      ReadMapPin(PStrings[offset]);
+    } else {
+      for (unsigned int i = 0; i < configuration.outputs; i++) {
+        const unsigned int normalizedValue = InputOfPin(PInput + offset, i);
+        if (previousNormalizedPInput[offset + i] != normalizedValue) {
+          previousNormalizedPInput[offset + i] = normalizedValue;
+          if (configuration.stagedRouting)
+            stagedInputOfOutput[i] = normalizedValue;
+          else
+            Tie(normalizedValue,
+                i + 1); // i is 0-based but device parameters are 1-based
+        }
       }
     }
 
-    offset += configuration.outputs;
+    offset += configuration.RoutingPins();
 
     if (configuration.includeInputNames) {
       char* a = PStrings[offset];
@@ -162,10 +494,8 @@ void Simulation::Calculate(double* PInput, double* POutput, char** PStrings)
       size_t i = 0;
       while (a != nullptr && i < previousInputNames.size()) {
         size_t a_len = b == nullptr ? strlen(a) : static_cast<size_t>(b - a);
-        if (strncmp(previousInputNames[i].c_str(), a, a_len) != 0) {
-          previousInputNames[i] = std::string(a, a_len);
+        if (AssignIfChanged(previousInputNames[i], a, a_len))
           device->set_input_name(i + 1, previousInputNames[i]);
-        }
         ++i;
         a = b == nullptr ? nullptr : b + 1;
         b = a == nullptr ? nullptr : strstr(a, ";");
@@ -180,28 +510,59 @@ void Simulation::Calculate(double* PInput, double* POutput, char** PStrings)
       size_t i = 0;
       while (a != nullptr && i < previousOutputNames.size()) {
         size_t a_len = b == nullptr ? strlen(a) : static_cast<size_t>(b - a);
-        if (strncmp(previousOutputNames[i].c_str(), a, a_len) != 0) {
-          previousOutputNames[i] = std::string(a, a_len);
+        if (AssignIfChanged(previousOutputNames[i], a, a_len))
           device->set_output_name(i + 1, previousOutputNames[i]);
-        }
         ++i;
         a = b == nullptr ? nullptr : b + 1;
         b = a == nullptr ? nullptr : strstr(a, ";");
       }
+
+      offset += 1;
+    }
+
+    if (configuration.stagedRouting) {
+      const unsigned int normalizedTake =
+        normalizeToUnsignedInt(PInput[offset]);
+
+      // Only a rising edge commits the staged ties.
+      if (previousNormalizedTake == 0 && normalizedTake != 0)
+        TieMultiple(stagedInputOfOutput);
+
+      previousNormalizedTake = normalizedTake;
     }
   }
 
   memcpy(POutput, nextPOutput.data(), nextPOutputSizeInBytes);
 
+  if (configuration.statisticsPins)
+    WriteStatisticsPins(POutput);
+
+  if (configuration.tallyPins)
+    memcpy(POutput + tallyPinIndex,
+           tallyOfInput.data(),
+           tallyOfInput.size() * sizeof(double));
+
   memcpy(PStrings[2], errorMessage.data(), errorMessage.size() + 1);
 
+  if (configuration.mapPins)
+    WriteMapPin(PStrings[3]);
+
   if (configuration.includeInputNames) {
-    const size_t offset = 3 + configuration.outputs;
+    const size_t offset = 3 + configuration.RoutingPins();
     memcpy(PStrings[offset], nextInputNames.data(), nextInputNames.size());
   }
 
   if (configuration.includeOutputNames) {
-    const size_t offset = 3 + configuration.outputs + 1;
+    const size_t offset = 3 + configuration.RoutingPins() +
+                          (configuration.includeInputNames ? 1 : 0);
     memcpy(PStrings[offset], nextOutputNames.data(), nextOutputNames.size());
   }
+
+  if (trace)
+    trace->record(SerialTrace::Kind::StepEnd,
+                  0,
+                  step,
+                  nullptr,
+                  0,
+                  SerialTrace::Clock::now());
 }
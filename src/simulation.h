@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
+
 #include <boost/asio/io_service.hpp>
 
 #include "configuration.h"
 #include "device.h"
+#include "presetlibrary.h"
+#include "serialtrace.h"
 
 class Simulation
 {
@@ -13,9 +17,37 @@ public:
 
   void Calculate(double* PInput, double* POutput, char** PStrings);
 
+  //! Names of the statistics output pins in the order of the pins.
+  static const std::array<const char*, Configuration::statistics_pin_count>
+    StatisticsPinNames;
+
 private:
+  void StoreHostPreset(unsigned int index);
+  void RecallHostPreset(unsigned int index);
+  void Tie(unsigned int input, unsigned int output);
+  void TieMultiple(const std::vector<unsigned int>& inputOfOutput);
+  //! Input of an OUT pin, unpacked from the pin of the output with compact
+  //! pins.
+  //! @param output 0-based index of the output
+  unsigned int InputOfPin(const double* pins, size_t output) const;
+  //! Show the input of an output on its OUT pin.
+  //! @param output 0-based index of the output
+  void ShowInput(size_t output, unsigned int input);
+  //! Tie or stage the outputs whose entry of the $MAP input pin changed.
+  void ReadMapPin(const char* map);
+  //! Copy the routing to the $MAP output pin, encoding it if it changed.
+  void WriteMapPin(char* map);
+  void UpdatePendingPin();
+  //! Show how many outputs an input is routed to on its TALLY pin. Called on
+  //! the io service thread, where the routing index of the device is valid.
+  void UpdateTallyPin(unsigned int input);
+  void WriteStatisticsPins(double* POutput) const;
+
   Configuration configuration;
+  //! Declared before the device, which records into it until destroyed.
+  std::unique_ptr<SerialTrace> trace;
   std::unique_ptr<Device> device;
+  std::unique_ptr<PresetLibrary> presetLibrary;
   boost::asio::io_service io_service;
   std::unique_ptr<boost::asio::io_service::work> work;
   std::unique_ptr<std::thread> thread;
@@ -24,10 +56,33 @@ private:
   std::vector<unsigned int> previousNormalizedPInput;
   std::vector<std::string> previousInputNames;
   std::vector<std::string> previousOutputNames;
+  std::vector<unsigned int> stagedInputOfOutput;
+  std::vector<unsigned int> confirmedInputOfOutput;
+  std::vector<unsigned int> pendingTies;
+  //! Input shown for each output, to pack them into compact or $MAP pins.
+  std::vector<unsigned int> shownInputOfOutput;
+  //! $MAP input pin of the previous step.
+  std::string previousMap;
+  //! Routing to request for the changes of the $MAP input pin.
+  std::vector<unsigned int> mapInputOfOutput;
+  //! Encoded $MAP output pin.
+  std::string nextMap;
+  //! Incremented whenever the shown routing changes.
+  uint32_t routingGeneration = 0;
+  //! Generation of the routing nextMap holds.
+  uint32_t encodedGeneration = 0;
+  size_t pendingPinIndex = 0;
+  size_t statisticsPinIndex = 0;
+  size_t tallyPinIndex = 0;
+  //! Number of outputs each input is routed to, index 0 is input 1.
+  std::vector<double> tallyOfInput;
+  unsigned int previousNormalizedTake{ 0 };
   std::vector<double> nextPOutput;
   std::string nextInputNames;
   std::string nextOutputNames;
   std::string errorMessage;
   bool canCommunicate{ false };
   size_t nextPOutputSizeInBytes = 0;
+  //! Number of the simulation step in the trace.
+  uint32_t step = 0;
 };
@@ -0,0 +1,11 @@
+#include "steadyclock.h"
+
+SteadyClock::time_point SteadyClock::now() noexcept
+{
+  return std::chrono::steady_clock::now();
+}
+
+SteadyClock::duration SteadyClock::to_wait_duration(const duration& d)
+{
+  return d;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+
+#include <boost/asio/basic_waitable_timer.hpp>
+
+/**
+ * @brief Clock of all timing in the protocol engine.
+ *
+ * Behaves like std::chrono::steady_clock, but now() lives in its own
+ * translation unit, so tests can link a virtual clock instead and run hours
+ * of protocol time in milliseconds. The clock is its own wait traits for
+ * SteadyTimer.
+ */
+struct SteadyClock
+{
+  using duration = std::chrono::steady_clock::duration;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::steady_clock::time_point;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept;
+
+  //! How long the io service may block for a timer that expires after d.
+  static duration to_wait_duration(const duration& d);
+};
+
+//! Timer on SteadyClock.
+using SteadyTimer = boost::asio::basic_waitable_timer<SteadyClock, SteadyClock>;
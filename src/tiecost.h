@@ -0,0 +1,96 @@
+#pragma once
+
+#include <optional>
+#include <stddef.h>
+
+#include "requestbuffer.h"
+
+/**
+ * @brief Number of bytes the requests changing the routing take on the wire.
+ *
+ * Device encodes each batch of ties the cheapest way it knows. The SIS has no
+ * short form for other patterns like a diagonal, so the only alternative to
+ * quick multiple ties is tying one input to all outputs.
+ */
+namespace TieCost {
+
+//! Number of decimal digits of a channel.
+constexpr size_t digits(unsigned int value)
+{
+  size_t count = 1;
+  for (; value >= 10; value /= 10)
+    ++count;
+  return count;
+}
+
+//! Bytes of "in*out!".
+constexpr size_t tie(unsigned int input, unsigned int output)
+{
+  return digits(input) + 1 + digits(output) + 1;
+}
+
+//! Bytes of "in*!", which ties the input to all outputs.
+constexpr size_t tie_all(unsigned int input)
+{
+  return digits(input) + 2;
+}
+
+//! Bytes of "\x1B+Q" and "\r" around the ties of a quick multiple tie.
+constexpr size_t quick_tie_overhead = 4;
+
+/**
+ * @brief Bytes of the requests tying each output whose input changes.
+ * @param input_of_output requested input of each output, index 0 is output 1
+ * @param current input of each output now
+ *
+ * The ties are batched into quick multiple ties, which are split like Device
+ * splits them to fit into a RequestBuffer.
+ */
+template<typename Requested, typename Current>
+size_t ties(const Requested& input_of_output, const Current& current)
+{
+  size_t bytes = 0;
+  size_t request = 0;
+  for (size_t i = 0; i < input_of_output.size() && i < current.size(); ++i) {
+    if (input_of_output[i] == current[i])
+      continue;
+
+    const size_t size =
+      tie(input_of_output[i], static_cast<unsigned int>(i + 1));
+    // request already counts the terminating \r.
+    if (request == 0 || request + size > RequestBuffer::capacity) {
+      bytes += request;
+      request = quick_tie_overhead;
+    }
+    request += size;
+  }
+  return bytes + request;
+}
+
+/**
+ * @brief Input to tie to all outputs instead of sending ties(), if that is
+ * shorter.
+ *
+ * Only routings with the same input on every output qualify. Tying all
+ * outputs and correcting the others afterwards would briefly show the wrong
+ * input on them.
+ */
+template<typename Requested, typename Current>
+std::optional<unsigned int> broadcast_input(const Requested& input_of_output,
+                                            const Current& current)
+{
+  if (current.empty() || input_of_output.size() < current.size())
+    return std::nullopt;
+
+  const unsigned int input = input_of_output[0];
+  for (size_t i = 1; i < current.size(); ++i) {
+    if (input_of_output[i] != input)
+      return std::nullopt;
+  }
+
+  if (tie_all(input) >= ties(input_of_output, current))
+    return std::nullopt;
+  return input;
+}
+
+}
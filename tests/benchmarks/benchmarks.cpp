@@ -0,0 +1,441 @@
+// Benchmarks of the hot paths of the DLL.
+//
+// Every benchmark prints one JSON object per line with the durations of its
+// samples in nanoseconds, so results of different releases can be compared by
+// scripts. Run with a name as argument to only run the benchmarks whose name
+// contains it.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "emulateddevice.h"
+#include "requestbuffer.h"
+#include "requestscheduler.h"
+#include "serialtrace.h"
+#include "simulation.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const size_t sampleCount = 10000;
+
+//! Results of benchmarks are written here, so they are not optimized away.
+volatile size_t sink;
+
+//! Durations of repeated runs of one benchmark.
+class Samples
+{
+public:
+  //! @param operationsPerSample number of operations timed by each sample,
+  //! for operations too short to be timed one by one
+  explicit Samples(std::string name, size_t operationsPerSample = 1)
+    : name(std::move(name))
+    , operationsPerSample(operationsPerSample)
+  {
+    durations.reserve(sampleCount);
+  }
+
+  template<typename F>
+  void Measure(F f)
+  {
+    const Clock::time_point start = Clock::now();
+    f();
+    durations.push_back(
+      std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+      operationsPerSample);
+  }
+
+  //! Add a sample which was not measured with the wall clock.
+  void Add(std::chrono::nanoseconds duration)
+  {
+    durations.push_back(static_cast<double>(duration.count()) /
+                        operationsPerSample);
+  }
+
+  void Print(std::ostream& out)
+  {
+    std::sort(durations.begin(), durations.end());
+    double sum = 0.0;
+    for (double duration : durations)
+      sum += duration;
+
+    out << "{\"name\":\"" << name << "\",\"unit\":\"ns\",\"samples\":"
+        << durations.size() << ",\"min\":" << durations.front()
+        << ",\"mean\":" << sum / durations.size()
+        << ",\"p50\":" << Percentile(0.5) << ",\"p99\":" << Percentile(0.99)
+        << ",\"max\":" << durations.back() << "}" << std::endl;
+  }
+
+private:
+  double Percentile(double p) const
+  {
+    return durations[static_cast<size_t>(p * (durations.size() - 1))];
+  }
+
+  std::string name;
+  size_t operationsPerSample;
+  std::vector<double> durations;
+};
+
+//! Simulation of an emulated matrix, by default 8x8 with name pins and an OUT
+//! pin per output.
+struct EmulatedSimulation
+{
+  static const size_t outputs = 8;
+  static const size_t inputNames = 2 + outputs;
+  static const size_t outputNames = 3 + outputs;
+
+  MatrixEmulator emulator;
+  std::array<double, Configuration::max_pins> PInput{};
+  std::array<double, Configuration::max_pins> POutput{};
+  std::array<std::array<char, 1000>, Configuration::max_pins> PStringsMemory{};
+  std::array<char*, Configuration::max_pins> PStrings;
+  std::unique_ptr<Simulation> simulation;
+
+  explicit EmulatedSimulation(unsigned int size = 8,
+                              bool namePins = true,
+                              bool mapPins = false)
+    : emulator(size, size)
+  {
+    for (size_t i = 0; i < PStringsMemory.size(); ++i)
+      PStrings[i] = PStringsMemory[i].data();
+
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [this](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = size;
+    configuration.outputs = size;
+    configuration.includeInputNames = namePins;
+    configuration.includeOutputNames = namePins;
+    configuration.mapPins = mapPins;
+    simulation = std::make_unique<Simulation>(configuration);
+    serialPortFakeInstance.pumpUntilIdle();
+
+    // Send the names and let the device cache its presets.
+    for (int i = 0; i < 10; ++i)
+      Calculate();
+  }
+
+  void Calculate()
+  {
+    simulation->Calculate(PInput.data(), POutput.data(), PStrings.data());
+    serialPortFakeInstance.pumpUntilIdle();
+  }
+};
+
+void CalculateIdle()
+{
+  EmulatedSimulation emulated;
+  Samples samples("calculate_idle");
+  for (size_t i = 0; i < sampleCount; ++i) {
+    samples.Measure([&]() {
+      emulated.simulation->Calculate(emulated.PInput.data(),
+                                     emulated.POutput.data(),
+                                     emulated.PStrings.data());
+    });
+  }
+  samples.Print(std::cout);
+}
+
+//! Idle steps of a 128x128 matrix with an OUT pin per output or $MAP pins.
+//! Without name pins, whose 128 names would dominate.
+void CalculateIdle128(const char* name, bool mapPins)
+{
+  auto emulated = std::make_unique<EmulatedSimulation>(128, false, mapPins);
+  if (mapPins)
+    memset(emulated->PStrings[2], '0', 2 * 128);
+  Samples samples(name);
+  for (size_t i = 0; i < sampleCount; ++i) {
+    samples.Measure([&]() {
+      emulated->simulation->Calculate(emulated->PInput.data(),
+                                      emulated->POutput.data(),
+                                      emulated->PStrings.data());
+    });
+  }
+  samples.Print(std::cout);
+}
+
+void CalculateIdle128Pins()
+{
+  CalculateIdle128("calculate_idle_128_pins", false);
+}
+
+void CalculateIdle128Map()
+{
+  CalculateIdle128("calculate_idle_128_map", true);
+}
+
+void CalculateOutChange()
+{
+  EmulatedSimulation emulated;
+  Samples samples("calculate_out_change");
+  for (size_t i = 0; i < sampleCount; ++i) {
+    emulated.PInput[2 + i % EmulatedSimulation::outputs] =
+      static_cast<double>(i / EmulatedSimulation::outputs % 8 + 1);
+    samples.Measure([&]() {
+      emulated.simulation->Calculate(emulated.PInput.data(),
+                                     emulated.POutput.data(),
+                                     emulated.PStrings.data());
+    });
+    serialPortFakeInstance.pumpUntilIdle();
+  }
+  samples.Print(std::cout);
+}
+
+void CalculateNameChange()
+{
+  EmulatedSimulation emulated;
+  Samples samples("calculate_name_change");
+  const std::array<const char*, 2> names{ { "CAM 1;CAM 2;CAM 3;CAM 4",
+                                            "CAM 1;CAM 2;CAM X;CAM 4" } };
+  for (size_t i = 0; i < sampleCount; ++i) {
+    strcpy(emulated.PStrings[EmulatedSimulation::inputNames], names[i % 2]);
+    samples.Measure([&]() {
+      emulated.simulation->Calculate(emulated.PInput.data(),
+                                     emulated.POutput.data(),
+                                     emulated.PStrings.data());
+    });
+    serialPortFakeInstance.pumpUntilIdle();
+  }
+  samples.Print(std::cout);
+}
+
+//! Time reading and processing a response line. The request is sent before
+//! and its bytes are dropped, so the emulator does not answer it.
+template<typename Send>
+void ResponseLine(const char* name, Send send, const std::string& response)
+{
+  EmulatedDevice emulated;
+  Samples samples(name);
+  for (size_t i = 0; i < sampleCount; ++i) {
+    send(emulated.device, i);
+    serialPortFakeInstance.written.clear();
+    serialPortFakeInstance.receive(response);
+    samples.Measure([&]() { emulated.Run(); });
+  }
+  samples.Print(std::cout);
+}
+
+void ResponseTieLine()
+{
+  ResponseLine("response_tie",
+               [](Device& device, size_t i) {
+                 device.tie(static_cast<unsigned int>(i % 2 + 1), 2);
+               },
+               "Out02 In01 All\r\n");
+}
+
+void ResponseQuickTieLine()
+{
+  ResponseLine(
+    "response_quick_tie",
+    [](Device& device, size_t i) {
+      const unsigned int input = static_cast<unsigned int>(i % 2 + 1);
+      device.tie_multiple(std::vector<unsigned int>(8, input));
+    },
+    "Qik\r\n");
+}
+
+void EncodeTie()
+{
+  const size_t operations = 1000;
+  Samples samples("encode_tie", operations);
+  size_t size = 0;
+  for (size_t i = 0; i < sampleCount; ++i) {
+    samples.Measure([&]() {
+      for (unsigned int j = 0; j < operations; ++j) {
+        RequestBuffer str;
+        str << j % 64 + 1 << '*' << j % 32 + 1 << '!';
+        size += str.size();
+      }
+    });
+  }
+  sink = size;
+  samples.Print(std::cout);
+}
+
+void EncodeQuickTie()
+{
+  const size_t operations = 100;
+  Samples samples("encode_quick_tie_16", operations);
+  size_t size = 0;
+  for (size_t i = 0; i < sampleCount; ++i) {
+    samples.Measure([&]() {
+      for (unsigned int j = 0; j < operations; ++j) {
+        RequestBuffer str;
+        str << "\x1B+Q";
+        for (unsigned int output = 1; output <= 16; ++output)
+          str << (j + output) % 64 + 1 << '*' << output << '!';
+        str << '\r';
+        size += str.size();
+      }
+    });
+  }
+  sink = size;
+  samples.Print(std::cout);
+}
+
+void TraceRecord()
+{
+  const char* const path = "benchmark_trace.trc";
+  const size_t operations = 1000;
+  Samples samples("trace_record", operations);
+  {
+    SerialTrace trace(path);
+    if (!trace.open()) {
+      std::cerr << "Unable to create " << path << std::endl;
+      return;
+    }
+    const char request[] = "12*34!";
+    for (size_t i = 0; i < sampleCount; ++i) {
+      const Clock::time_point now = Clock::now();
+      samples.Measure([&]() {
+        for (size_t j = 0; j < operations; ++j)
+          trace.record(SerialTrace::Kind::Sent,
+                       1,
+                       static_cast<uint32_t>(j),
+                       request,
+                       sizeof(request) - 1,
+                       now);
+      });
+    }
+  }
+  std::remove(path);
+  samples.Print(std::cout);
+}
+
+void TieLatency()
+{
+  EmulatedDevice emulated;
+  Samples samples("tie_latency_emulator");
+  for (size_t i = 0; i < sampleCount; ++i) {
+    const unsigned int input = static_cast<unsigned int>(i % 8 + 1);
+    const unsigned int output = static_cast<unsigned int>(i / 8 % 8 + 1);
+    samples.Measure([&]() {
+      emulated.device.tie(input, output);
+      while (emulated.inputOfOutput[output - 1] != input) {
+        emulated.Run();
+      }
+    });
+  }
+  samples.Print(std::cout);
+}
+
+//! Time the bytes of the whole startup of the emulated matrix, including its
+//! names and presets, take on the serial line.
+void StartupLineTime(const char* name, const EmulatedLink& link)
+{
+  Samples samples(name);
+  for (size_t i = 0; i < 10; ++i) {
+    EmulatedDevice emulated(nullptr, link);
+    samples.Add(emulated.lineTime);
+  }
+  samples.Print(std::cout);
+}
+
+void StartupLineTime9600()
+{
+  StartupLineTime("startup_line_time_9600", EmulatedLink());
+}
+
+void StartupLineTimeNegotiated()
+{
+  EmulatedLink link;
+  link.negotiateBaudRate = true;
+  StartupLineTime("startup_line_time_negotiated", link);
+}
+
+//! Time requests of each class wait in the queue on a 9600 baud connection
+//! where every request costs its own bytes plus a response of about 16 bytes.
+//! Operators tie every 100 ms while a full synchronization of 64 ties and 128
+//! names is running. The time is virtual, so each sample is a wait.
+void QueueWaitTimes()
+{
+  using Type = Device::RequestType;
+  RequestScheduler<Device::Request> scheduler(1024);
+  Clock::time_point now;
+  const auto byteTime = std::chrono::microseconds(10 * 1000000 / 9600);
+
+  scheduler.push(
+    RequestClass::Monitoring, { Type::RequestInformation, "I" }, now);
+  for (int block = 0; block < 4; ++block)
+    scheduler.push(RequestClass::Monitoring,
+                   { Type::RequestCurrentConfiguration, "0*1*00VA" },
+                   now);
+  for (int name = 0; name < 128; ++name)
+    scheduler.push(RequestClass::Names,
+                   { Type::ReadVirtualOutputName, "\x1BNO12\r" },
+                   now);
+
+  std::array<Samples, 3> samples{ { Samples("queue_wait_control"),
+                                    Samples("queue_wait_monitoring"),
+                                    Samples("queue_wait_names") } };
+  Clock::time_point nextTie = now;
+  Device::Request request;
+  RequestClass requestClass;
+  Clock::duration waited;
+
+  while (now < Clock::time_point(std::chrono::seconds(60))) {
+    while (nextTie <= now) {
+      scheduler.push(RequestClass::Control, { Type::Tie, "12*34!" }, nextTie);
+      nextTie += std::chrono::milliseconds(100);
+    }
+
+    if (!scheduler.pop(request, now, &requestClass, &waited)) {
+      now = nextTie;
+      continue;
+    }
+
+    samples[static_cast<size_t>(requestClass)].Add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(waited));
+    now += byteTime * (request.request.size() + 16);
+  }
+
+  for (Samples& classSamples : samples)
+    classSamples.Print(std::cout);
+}
+
+struct Benchmark
+{
+  const char* name;
+  void (*run)();
+};
+
+const std::array<Benchmark, 14> benchmarks{ {
+  { "calculate_idle", CalculateIdle },
+  { "calculate_idle_128_pins", CalculateIdle128Pins },
+  { "calculate_idle_128_map", CalculateIdle128Map },
+  { "calculate_out_change", CalculateOutChange },
+  { "calculate_name_change", CalculateNameChange },
+  { "response_tie", ResponseTieLine },
+  { "response_quick_tie", ResponseQuickTieLine },
+  { "encode_tie", EncodeTie },
+  { "encode_quick_tie_16", EncodeQuickTie },
+  { "trace_record", TraceRecord },
+  { "tie_latency_emulator", TieLatency },
+  { "startup_line_time_9600", StartupLineTime9600 },
+  { "startup_line_time_negotiated", StartupLineTimeNegotiated },
+  { "queue_wait", QueueWaitTimes },
+} };
+}
+
+int main(int argc, char* argv[])
+{
+  const std::string filter = argc > 1 ? argv[1] : "";
+  for (const Benchmark& benchmark : benchmarks) {
+    if (std::string(benchmark.name).find(filter) != std::string::npos)
+      benchmark.run();
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <catch.hpp>
 
 #include <array>
+#include <cstdio>
 
 #include "trompeloeil.hpp"
 
@@ -555,6 +556,93 @@ SCENARIO("Input and output pins", "[dll]") {
       }
     }
   }
+
+  GIVEN("A configuration with 5 inputs and 2 outputs with names and TAKE") {
+    std::unique_ptr<double> PUser(new double);
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.get(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = true)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = true)
+      .LR_SIDE_EFFECT(_2.stagedRouting = true);
+
+    WHEN("Calling CNumInputsEx") {
+      unsigned char inputs = CNumInputsEx(PUser.get());
+      THEN("7 inputs are returned") { REQUIRE(inputs == 7); }
+    }
+
+    WHEN("Getting 6th input name") {
+      std::array<unsigned char, 100> name;
+      GetInputName(5, name.data());
+      THEN("It is '$OUTS'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "$OUTS");
+      }
+    }
+
+    WHEN("Getting 7th input name") {
+      std::array<unsigned char, 100> name;
+      GetInputName(6, name.data());
+      THEN("It is 'TAKE'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "TAKE");
+      }
+    }
+
+    WHEN("Calling CNumOutputsEx") {
+      unsigned char outputs = CNumOutputsEx(PUser.get());
+      THEN("7 outputs are returned") { REQUIRE(outputs == 7); }
+    }
+  }
+
+  GIVEN("A configuration with 128 inputs and 128 outputs with compact pins") {
+    std::unique_ptr<double> PUser(new double);
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.get(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 128)
+      .LR_SIDE_EFFECT(_2.outputs = 128)
+      .LR_SIDE_EFFECT(_2.compactPins = true);
+
+    WHEN("Calling CNumInputsEx") {
+      unsigned char inputs = CNumInputsEx(PUser.get());
+      THEN("28 inputs are returned") { REQUIRE(inputs == 28); }
+    }
+
+    WHEN("Getting 3rd input name") {
+      std::array<unsigned char, 100> name;
+      GetInputName(2, name.data());
+      THEN("It is 'OUT0-4'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "OUT0-4");
+      }
+    }
+
+    WHEN("Getting 28th input name") {
+      std::array<unsigned char, 100> name;
+      GetInputName(27, name.data());
+      THEN("It is 'OUT125-127'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "OUT125-127");
+      }
+    }
+
+    WHEN("Calling CNumOutputsEx") {
+      unsigned char outputs = CNumOutputsEx(PUser.get());
+      THEN("29 outputs are returned") { REQUIRE(outputs == 29); }
+    }
+
+    WHEN("Getting 29th output name") {
+      std::array<unsigned char, 100> name;
+      GetOutputName(28, name.data());
+      THEN("It is 'OUT125-127'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "OUT125-127");
+      }
+    }
+  }
 }
 
 SCENARIO("Simulation", "[dll]") {
@@ -580,7 +668,10 @@ SCENARIO("Simulation", "[dll]") {
     ALLOW_CALL(deviceMockInstance, Constructor(_, _))
       .LR_SIDE_EFFECT(device = _1);
 
-    ALLOW_CALL(deviceMockInstance, open("COM1"));
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(5, 2));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
     ALLOW_CALL(deviceMockInstance, close());
 
     CSimStart(PInput.data(), POutput.data(), PUser.data());
@@ -1016,3 +1107,489 @@ SCENARIO("Simulation", "[dll]") {
     }
   }
 }
+
+SCENARIO("Simulation with staged routing", "[dll]") {
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+  for (size_t i = 0; i < PStringsMemory.size(); ++i) {
+    PStrings[i] = PStringsMemory[i].data();
+  }
+  std::array<double, 100> PUser{};
+
+  WHEN("running the simulation") {
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.data(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = false)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = false)
+      .LR_SIDE_EFFECT(_2.stagedRouting = true);
+
+    Device* device;
+    ALLOW_CALL(deviceMockInstance, Constructor(_, _))
+      .LR_SIDE_EFFECT(device = _1);
+
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(_, _));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
+    ALLOW_CALL(deviceMockInstance, close());
+
+    CSimStart(PInput.data(), POutput.data(), PUser.data());
+
+    WHEN("connected to device") {
+
+      device->connectedCallback();
+
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_outputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(2);
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_inputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(5);
+      device->setupCallback();
+
+      CCalculateEx(
+        PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+      WHEN("the third and fourth pin are set to 2.0 and 3.0") {
+        PInput[2] = 2.0;
+        PInput[3] = 3.0;
+
+        THEN("nothing is tied") {
+          FORBID_CALL(deviceMockInstance, tie(_, _));
+          FORBID_CALL(deviceMockInstance, tie_multiple(_));
+
+          CCalculateEx(
+            PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+          WHEN("the TAKE pin is set to 5.0") {
+            PInput[4] = 5.0;
+
+            THEN("both ties are sent at once") {
+              REQUIRE_CALL(deviceMockInstance,
+                           tie_multiple(std::vector<unsigned int>{ 2, 3 }));
+
+              CCalculateEx(
+                PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+              WHEN("the TAKE pin stays at 5.0") {
+                THEN("nothing happens") {
+                  FORBID_CALL(deviceMockInstance, tie_multiple(_));
+
+                  CCalculateEx(PInput.data(),
+                               POutput.data(),
+                               PUser.data(),
+                               PStrings.data());
+                }
+              }
+            }
+          }
+        }
+      }
+
+      CSimStop(PInput.data(), POutput.data(), PUser.data());
+    }
+  }
+}
+
+SCENARIO("Simulation with host-side presets", "[dll]") {
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+  for (size_t i = 0; i < PStringsMemory.size(); ++i) {
+    PStrings[i] = PStringsMemory[i].data();
+  }
+  std::array<double, 100> PUser{};
+
+  std::remove("dll_test_presets.bin");
+
+  WHEN("running the simulation") {
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.data(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = false)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = false)
+      .LR_SIDE_EFFECT(_2.presetFile = "dll_test_presets.bin");
+
+    Device* device;
+    ALLOW_CALL(deviceMockInstance, Constructor(_, _))
+      .LR_SIDE_EFFECT(device = _1);
+
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(_, _));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
+    ALLOW_CALL(deviceMockInstance, close());
+
+    CSimStart(PInput.data(), POutput.data(), PUser.data());
+
+    WHEN("connected to device") {
+
+      device->connectedCallback();
+
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_outputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(2);
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_inputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(5);
+      device->setupCallback();
+
+      ALLOW_CALL(deviceMockInstance, tie(0, 1));
+      ALLOW_CALL(deviceMockInstance, tie(0, 2));
+
+      CCalculateEx(
+        PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+      WHEN("inputs 4 and 3 are tied and the first pin is set to 40.0") {
+        device->tieChanged(1, 4);
+        device->tieChanged(2, 3);
+        PInput[0] = 40.0;
+
+        THEN("the routing is stored on the host") {
+          FORBID_CALL(deviceMockInstance, store(_));
+
+          CCalculateEx(
+            PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+          WHEN("the second pin is set to 40.0") {
+            PInput[1] = 40.0;
+
+            THEN("the stored routing is tied at once") {
+              FORBID_CALL(deviceMockInstance, recall(_));
+              REQUIRE_CALL(deviceMockInstance,
+                           tie_multiple(std::vector<unsigned int>{ 4, 3 }));
+
+              CCalculateEx(
+                PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+            }
+          }
+        }
+      }
+
+      WHEN("the second pin is set to 7.0") {
+        PInput[1] = 7.0;
+
+        THEN("an error is reported") {
+          FORBID_CALL(deviceMockInstance, recall(_));
+          FORBID_CALL(deviceMockInstance, tie_multiple(_));
+
+          CCalculateEx(
+            PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+          REQUIRE(POutput[1] == 5.0);
+          REQUIRE(std::string(PStrings[2]) == "Preset 7 is not stored.");
+        }
+      }
+
+      CSimStop(PInput.data(), POutput.data(), PUser.data());
+    }
+  }
+
+  std::remove("dll_test_presets.bin");
+}
+
+SCENARIO("Simulation with optimistic ties", "[dll]") {
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+  for (size_t i = 0; i < PStringsMemory.size(); ++i) {
+    PStrings[i] = PStringsMemory[i].data();
+  }
+  std::array<double, 100> PUser{};
+
+  WHEN("running the simulation") {
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.data(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = false)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = false)
+      .LR_SIDE_EFFECT(_2.optimisticTies = true);
+
+    WHEN("Calling CNumOutputsEx") {
+      unsigned char outputs = CNumOutputsEx(PUser.data());
+      THEN("6 outputs are returned") { REQUIRE(outputs == 6); }
+    }
+
+    WHEN("Getting 6th output name") {
+      CNumOutputsEx(PUser.data());
+      std::array<unsigned char, 100> name;
+      GetOutputName(5, name.data());
+      THEN("It is 'PENDING'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "PENDING");
+      }
+    }
+
+    Device* device;
+    ALLOW_CALL(deviceMockInstance, Constructor(_, _))
+      .LR_SIDE_EFFECT(device = _1);
+
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(_, _));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
+    ALLOW_CALL(deviceMockInstance, close());
+
+    CSimStart(PInput.data(), POutput.data(), PUser.data());
+
+    WHEN("connected to device") {
+
+      device->connectedCallback();
+
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_outputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(2);
+      REQUIRE_CALL(deviceMockInstance, get_number_of_virtual_inputs())
+        .TIMES(AT_LEAST(1))
+        .RETURN(5);
+      device->setupCallback();
+
+      ALLOW_CALL(deviceMockInstance, tie(0, 1));
+      ALLOW_CALL(deviceMockInstance, tie(0, 2));
+
+      CCalculateEx(
+        PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+      device->tieChanged(1, 0);
+      device->tieChanged(2, 0);
+
+      WHEN("the fourth pin is set to 3.0") {
+        PInput[3] = 3.0;
+        REQUIRE_CALL(deviceMockInstance, tie(3, 2));
+
+        CCalculateEx(
+          PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+        THEN("the 5th pin is set to 3.0 before the device confirms") {
+          REQUIRE(POutput[4] == 3.0);
+        }
+
+        THEN("the 6th pin marks output 2 as pending") {
+          REQUIRE(POutput[5] == 2.0);
+        }
+
+        WHEN("the device confirms the tie") {
+          device->tieChanged(2, 3);
+          CCalculateEx(
+            PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+          THEN("the 5th pin stays at 3.0") { REQUIRE(POutput[4] == 3.0); }
+
+          THEN("no output is pending") { REQUIRE(POutput[5] == 0.0); }
+        }
+
+        WHEN("the tie fails") {
+          device->tieFailed(2);
+          CCalculateEx(
+            PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+          THEN("the 5th pin is rolled back to 0.0") {
+            REQUIRE(POutput[4] == 0.0);
+          }
+
+          THEN("no output is pending") { REQUIRE(POutput[5] == 0.0); }
+        }
+      }
+
+      CSimStop(PInput.data(), POutput.data(), PUser.data());
+    }
+  }
+}
+
+SCENARIO("Simulation with statistics pins", "[dll]") {
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+  for (size_t i = 0; i < PStringsMemory.size(); ++i) {
+    PStrings[i] = PStringsMemory[i].data();
+  }
+  std::array<double, 100> PUser{};
+
+  WHEN("running the simulation") {
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.data(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = false)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = false)
+      .LR_SIDE_EFFECT(_2.optimisticTies = true)
+      .LR_SIDE_EFFECT(_2.statisticsPins = true);
+
+    WHEN("Calling CNumOutputsEx") {
+      unsigned char outputs = CNumOutputsEx(PUser.data());
+      THEN("12 outputs are returned") { REQUIRE(outputs == 12); }
+    }
+
+    WHEN("Getting 7th output name") {
+      CNumOutputsEx(PUser.data());
+      std::array<unsigned char, 100> name;
+      GetOutputName(6, name.data());
+      THEN("It is 'SENT'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "SENT");
+      }
+    }
+
+    WHEN("Getting 12th output name") {
+      CNumOutputsEx(PUser.data());
+      std::array<unsigned char, 100> name;
+      GetOutputName(11, name.data());
+      THEN("It is 'RTT99'") {
+        std::string str(reinterpret_cast<char*>(&name.front()));
+        CHECK(str == "RTT99");
+      }
+    }
+
+    Device* device;
+    ALLOW_CALL(deviceMockInstance, Constructor(_, _))
+      .LR_SIDE_EFFECT(device = _1);
+
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(_, _));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
+    ALLOW_CALL(deviceMockInstance, close());
+
+    CSimStart(PInput.data(), POutput.data(), PUser.data());
+
+    WHEN("the device has communicated") {
+      DeviceStatistics statistics;
+      statistics.count_request(1);
+      statistics.count_request(1);
+      statistics.count_request(2);
+      statistics.count_response(std::chrono::milliseconds(8));
+      statistics.count_response(std::chrono::milliseconds(8));
+      statistics.count_error();
+      statistics.count_timeout();
+      statistics.set_queue_depth(0, 4);
+      ALLOW_CALL(deviceMockInstance, get_statistics())
+        .LR_RETURN(std::ref(statistics));
+
+      CCalculateEx(
+        PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+      THEN("the statistics pins show the counters") {
+        REQUIRE(POutput[6] == 3.0);
+        REQUIRE(POutput[7] == 1.0);
+        REQUIRE(POutput[8] == 1.0);
+        REQUIRE(POutput[9] == 4.0);
+      }
+
+      THEN("the statistics pins show the round trip times in ms") {
+        REQUIRE(POutput[10] >= 8.0);
+        REQUIRE(POutput[10] <= 10.0);
+        REQUIRE(POutput[11] == POutput[10]);
+      }
+
+      CSimStop(PInput.data(), POutput.data(), PUser.data());
+    }
+  }
+}
+
+SCENARIO("Simulation with tally pins", "[dll]") {
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+  for (size_t i = 0; i < PStringsMemory.size(); ++i) {
+    PStrings[i] = PStringsMemory[i].data();
+  }
+  std::array<double, 100> PUser{};
+
+  WHEN("running the simulation") {
+    ALLOW_CALL(configurationMockInstance, Constructor(PUser.data(), _))
+      .LR_SIDE_EFFECT(_2.present = true)
+      .LR_SIDE_EFFECT(_2.comPort = "COM1")
+      .LR_SIDE_EFFECT(_2.inputs = 5)
+      .LR_SIDE_EFFECT(_2.outputs = 2)
+      .LR_SIDE_EFFECT(_2.includeInputNames = false)
+      .LR_SIDE_EFFECT(_2.includeOutputNames = false)
+      .LR_SIDE_EFFECT(_2.statisticsPins = true)
+      .LR_SIDE_EFFECT(_2.tallyPins = true);
+
+    WHEN("Calling CNumOutputsEx") {
+      unsigned char outputs = CNumOutputsEx(PUser.data());
+      THEN("16 outputs are returned") { REQUIRE(outputs == 16); }
+    }
+
+    WHEN("Getting the output names after the statistics pins") {
+      CNumOutputsEx(PUser.data());
+      std::array<unsigned char, 100> first;
+      GetOutputName(11, first.data());
+      std::array<unsigned char, 100> last;
+      GetOutputName(15, last.data());
+      THEN("They are 'TALLY1' to 'TALLY5'") {
+        CHECK(std::string(reinterpret_cast<char*>(&first.front())) ==
+              "TALLY1");
+        CHECK(std::string(reinterpret_cast<char*>(&last.front())) ==
+              "TALLY5");
+      }
+    }
+
+    Device* device;
+    ALLOW_CALL(deviceMockInstance, Constructor(_, _))
+      .LR_SIDE_EFFECT(device = _1);
+
+    ALLOW_CALL(deviceMockInstance, set_synchronized_names(_, _));
+    ALLOW_CALL(deviceMockInstance,
+               set_name_verification(Device::NameVerification::Always));
+    ALLOW_CALL(deviceMockInstance, open("COM1", 9600, false));
+    ALLOW_CALL(deviceMockInstance, close());
+
+    DeviceStatistics statistics;
+    ALLOW_CALL(deviceMockInstance, get_statistics())
+      .LR_RETURN(std::ref(statistics));
+
+    CSimStart(PInput.data(), POutput.data(), PUser.data());
+
+    WHEN("an input is tied to both outputs") {
+      trompeloeil::sequence seq;
+      REQUIRE_CALL(deviceMockInstance, count_outputs_of_input(4))
+        .IN_SEQUENCE(seq)
+        .RETURN(1);
+      REQUIRE_CALL(deviceMockInstance, count_outputs_of_input(4))
+        .IN_SEQUENCE(seq)
+        .RETURN(2);
+      device->tieChanged(1, 4);
+      device->tieChanged(2, 4);
+
+      CCalculateEx(
+        PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+      THEN("its tally pin counts them") {
+        REQUIRE(POutput[11 + 3] == 2.0);
+        REQUIRE(POutput[11] == 0.0);
+      }
+
+      AND_WHEN("one output is tied to another input") {
+        REQUIRE_CALL(deviceMockInstance, count_outputs_of_input(4))
+          .RETURN(1);
+        REQUIRE_CALL(deviceMockInstance, count_outputs_of_input(1))
+          .RETURN(1);
+        device->tieChanged(2, 1);
+
+        CCalculateEx(
+          PInput.data(), POutput.data(), PUser.data(), PStrings.data());
+
+        THEN("both tally pins change") {
+          REQUIRE(POutput[11 + 3] == 1.0);
+          REQUIRE(POutput[11] == 1.0);
+        }
+      }
+    }
+
+    CSimStop(PInput.data(), POutput.data(), PUser.data());
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "device.h"
+#include "matrixemulator.h"
+#include "serialport_fake.h"
+#include "serialtrace.h"
+#include "steadyclock_fake.h"
+
+//! Serial connection between the device and the emulated matrix.
+struct EmulatedLink
+{
+  //! Rate the device opens the port with.
+  unsigned int baudRate = 9600;
+  //! Whether the device negotiates the rate.
+  bool negotiateBaudRate = false;
+  //! Rate the matrix starts with.
+  unsigned int matrixBaudRate = 9600;
+  //! Fastest rate the matrix supports.
+  unsigned int matrixMaxBaudRate = 115200;
+};
+
+//! Device connected to an emulated matrix through the fake serial port.
+struct EmulatedDevice
+{
+  VirtualIoService io_service;
+  MatrixEmulator emulator;
+  Device device{ io_service };
+  bool connected = false;
+  std::vector<unsigned int> inputOfOutput;
+  std::vector<uint16_t> failedTies;
+  std::vector<std::string> errors;
+  //! Time the bytes exchanged so far took on the serial line.
+  SteadyClock::duration lineTime{};
+
+  //! @param trace records the whole session if given
+  //! @param size number of inputs and outputs of the matrix
+  explicit EmulatedDevice(SerialTrace* trace = nullptr,
+                          const EmulatedLink& link = EmulatedLink(),
+                          unsigned int size = 8)
+    : emulator(size, size)
+    , inputOfOutput(size, 0)
+  {
+    emulator.baudRate = link.matrixBaudRate;
+    emulator.maxBaudRate = link.matrixMaxBaudRate;
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [this](const std::string& request) {
+      // Bytes sent with another rate than the matrix uses are garbage to it.
+      const unsigned int rate = serialPortFakeInstance.baud_rate;
+      if (rate != emulator.baudRate)
+        return std::string();
+
+      const std::string response = emulator.Respond(request);
+      // 10 bits per byte with the start and the stop bit.
+      lineTime += std::chrono::duration_cast<SteadyClock::duration>(
+        std::chrono::duration<double>(
+          (request.size() + response.size()) * 10.0 / rate));
+      return response;
+    };
+
+    device.connectedCallback = [this]() { connected = true; };
+    device.setupCallback = []() {};
+    device.tieChanged = [this](uint16_t out, uint16_t in) {
+      inputOfOutput[out - 1] = in;
+    };
+    device.tieFailed = [this](uint16_t out) { failedTies.push_back(out); };
+    device.inputNameChanged = [](uint16_t, std::string) {};
+    device.outputNameChanged = [](uint16_t, std::string) {};
+    device.reportError = [this](const std::string& error) {
+      errors.push_back(error);
+    };
+
+    device.set_trace(trace);
+    device.open("EMULATOR", link.baudRate, link.negotiateBaudRate);
+    Run();
+  }
+
+  ~EmulatedDevice()
+  {
+    device.close();
+    io_service.poll();
+  }
+
+  //! Exchange requests and responses until the device is idle.
+  void Run()
+  {
+    do {
+      io_service.poll();
+    } while (serialPortFakeInstance.pump());
+  }
+
+  //! Exchange requests and responses while the virtual time moves forward.
+  void RunFor(SteadyClock::duration duration)
+  {
+    const SteadyClock::time_point end = SteadyClock::now() + duration;
+    while (SteadyClock::now() < end) {
+      io_service.advance(std::min<SteadyClock::duration>(
+        std::chrono::milliseconds(10), end - SteadyClock::now()));
+      Run();
+    }
+  }
+};
@@ -0,0 +1,152 @@
+#include "matrixemulator.h"
+
+#include <algorithm>
+#include <regex>
+
+#include <boost/format.hpp>
+
+namespace {
+const unsigned int number_of_presets = 32;
+
+namespace RequestPatterns {
+  const std::regex information("^I$");
+  const std::regex tie("^([0-9]+)\\*([0-9]+)!$");
+  const std::regex tie_all("^([0-9]+)\\*!$");
+  const std::regex quick_tie("^\x1B\\+Q((?:[0-9]+\\*[0-9]+!)+)\r$");
+  const std::regex ties("^([0-9]+)\\*([0-9]+)\\*00VA$");
+  const std::regex store("^([0-9]+),$");
+  const std::regex recall("^([0-9]+)\\.$");
+  const std::regex read_name("^\x1BN([IO])([0-9]+)\r$");
+  const std::regex write_name("^\x1Bn([IO])([0-9]+),([^\r]*)\r$");
+  const std::regex baud_rate("^\x1B" "1\\*([0-9]+),n,8,1CP\r$");
+}
+
+const std::string invalid_input = "E01\r\n";
+const std::string invalid_command = "E10\r\n";
+const std::string invalid_preset = "E11\r\n";
+const std::string invalid_value = "E13\r\n";
+}
+
+MatrixEmulator::MatrixEmulator(unsigned int inputs, unsigned int outputs)
+  : inputs(inputs)
+  , outputs(outputs)
+  , ties(outputs, 0)
+  , presets(number_of_presets, std::vector<unsigned int>(outputs, 0))
+  , inputNames(inputs)
+  , outputNames(outputs)
+{
+  for (unsigned int i = 0; i < inputs; ++i)
+    inputNames[i] = (boost::format("Input %1%") % (i + 1)).str();
+  for (unsigned int i = 0; i < outputs; ++i)
+    outputNames[i] = (boost::format("Output %1%") % (i + 1)).str();
+}
+
+std::string MatrixEmulator::Respond(const std::string& request)
+{
+  std::smatch m;
+  if (std::regex_match(request, RequestPatterns::information)) {
+    return (boost::format(
+              "I%02dX%02d T1 U1 M%02dX%02d Vmt0 Amt0 Sys1 Dgn00\r\n") %
+            inputs % outputs % inputs % outputs)
+      .str();
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::tie))
+    return Tie(std::stoul(m.str(1)), std::stoul(m.str(2)));
+
+  if (std::regex_match(request, m, RequestPatterns::tie_all)) {
+    const unsigned int input = std::stoul(m.str(1));
+    if (input > inputs)
+      return invalid_input;
+    std::fill(ties.begin(), ties.end(), input);
+    return (boost::format("In%02d All\r\n") % input).str();
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::quick_tie)) {
+    const std::string list = m.str(1);
+    static const std::regex tie("([0-9]+)\\*([0-9]+)!");
+    for (std::sregex_iterator it(list.begin(), list.end(), tie), end;
+         it != end;
+         ++it) {
+      if (Tie(std::stoul(it->str(1)), std::stoul(it->str(2))) ==
+          invalid_input)
+        return invalid_input;
+    }
+    return "Qik\r\n";
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::ties)) {
+    const unsigned int preset = std::stoul(m.str(1));
+    const unsigned int start_output = std::stoul(m.str(2));
+    if (preset > number_of_presets || start_output < 1)
+      return invalid_preset;
+
+    const std::vector<unsigned int>& source =
+      preset == 0 ? ties : presets[preset - 1];
+    // Frames with more than 99 inputs answer with three digits.
+    const char* const format = inputs > 99 ? "%03d " : "%02d ";
+    std::string response;
+    for (unsigned int output = start_output; output < start_output + 16;
+         ++output) {
+      const unsigned int input =
+        output <= outputs ? source[output - 1] : 0;
+      response += (boost::format(format) % input).str();
+    }
+    return response + "All\r\n";
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::store)) {
+    const unsigned int preset = std::stoul(m.str(1));
+    if (preset < 1 || preset > number_of_presets)
+      return invalid_preset;
+    presets[preset - 1] = ties;
+    return (boost::format("Spr%02d\r\n") % preset).str();
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::recall)) {
+    const unsigned int preset = std::stoul(m.str(1));
+    if (preset < 1 || preset > number_of_presets)
+      return invalid_preset;
+    ties = presets[preset - 1];
+    return (boost::format("Rpr%02d\r\n") % preset).str();
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::read_name)) {
+    std::vector<std::string>& names =
+      m.str(1) == "I" ? inputNames : outputNames;
+    const unsigned int index = std::stoul(m.str(2));
+    if (index < 1 || index > names.size())
+      return invalid_input;
+    return names[index - 1] + "\r\n";
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::write_name)) {
+    std::vector<std::string>& names =
+      m.str(1) == "I" ? inputNames : outputNames;
+    const unsigned int index = std::stoul(m.str(2));
+    if (index < 1 || index > names.size())
+      return invalid_input;
+    names[index - 1] = m.str(3);
+    return "Nam" + m.str(1) + "\r\n";
+  }
+
+  if (std::regex_match(request, m, RequestPatterns::baud_rate)) {
+    const unsigned int rate = std::stoul(m.str(1));
+    if (rate < 300 || rate > maxBaudRate)
+      return invalid_value;
+    // The acknowledgement is still sent with the old rate.
+    baudRate = rate;
+    return (boost::format("Cpn1 Ccp%1%,n,8,1\r\n") % rate).str();
+  }
+
+  return invalid_command;
+}
+
+std::string MatrixEmulator::Tie(unsigned int input, unsigned int output)
+{
+  if (input > inputs || output < 1 || output > outputs)
+    return invalid_input;
+
+  ties[output - 1] = input;
+  return (boost::format("Out%02d In%02d All\r\n") % output % input).str();
+}
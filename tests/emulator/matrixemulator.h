@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Emulated Extron matrix which answers SIS requests like the device.
+ *
+ * Only the requests sent by Device are understood.
+ */
+class MatrixEmulator
+{
+public:
+  MatrixEmulator(unsigned int inputs, unsigned int outputs);
+
+  /**
+   * @brief Process the bytes of one request.
+   * @param request the request as written to the serial port
+   * @return the response lines including their \r\n
+   */
+  std::string Respond(const std::string& request);
+
+  const unsigned int inputs;
+  const unsigned int outputs;
+
+  //! Input of each output, index 0 is output 1.
+  std::vector<unsigned int> ties;
+  //! Ties of each preset, index 0 is preset 1.
+  std::vector<std::vector<unsigned int>> presets;
+  std::vector<std::string> inputNames;
+  std::vector<std::string> outputNames;
+  //! Bits per second of the serial port of the matrix.
+  unsigned int baudRate = 9600;
+  //! Fastest rate the serial port can be switched to.
+  unsigned int maxBaudRate = 115200;
+
+private:
+  std::string Tie(unsigned int input, unsigned int output);
+};
@@ -5,28 +5,48 @@ extern template struct trompeloeil::reporter<trompeloeil::specialized>;
 DeviceMock deviceMockInstance;
 
 Device::Device(boost::asio::io_service& io_service)
-  : number_of_presets(32)
+  : model(nullptr)
+  , number_of_presets(0)
   , number_of_virtual_inputs(0)
   , number_of_virtual_outputs(0)
+  , next_preset_to_cache(1)
+  , verifying_preset(0)
   , port(io_service)
   , buffer(2)
+  , response_timer(io_service)
   , request_in_progress({ RequestType::None, "" })
   , viewed_current_outputs(0) {
   deviceMockInstance.Constructor(this, io_service);
 }
 
-uint8_t Device::get_number_of_virtual_inputs() const {
+uint16_t Device::get_number_of_virtual_inputs() const {
   return deviceMockInstance.get_number_of_virtual_inputs();
 }
 
-uint8_t Device::get_number_of_virtual_outputs() const {
+uint16_t Device::get_number_of_virtual_outputs() const {
   return deviceMockInstance.get_number_of_virtual_outputs();
 }
 
+const DeviceStatistics& Device::get_statistics() const {
+  return deviceMockInstance.get_statistics();
+}
+
+const Device::OutputSet& Device::get_outputs_of_input(uint16_t input) const {
+  return deviceMockInstance.get_outputs_of_input(input);
+}
+
+uint16_t Device::count_outputs_of_input(uint16_t input) const {
+  return deviceMockInstance.count_outputs_of_input(input);
+}
+
 void Device::tie(unsigned int input, unsigned int output) {
   deviceMockInstance.tie(input, output);
 }
 
+void Device::tie_multiple(const std::vector<unsigned int>& input_of_output) {
+  deviceMockInstance.tie_multiple(input_of_output);
+}
+
 void Device::store(unsigned int index) {
   deviceMockInstance.store(index);
 }
@@ -35,22 +55,36 @@ void Device::recall(unsigned int index) {
   deviceMockInstance.recall(index);
 }
 
-void Device::set_input_name(uint8_t index, const std::string& name) {
+void Device::set_input_name(uint16_t index, const std::string& name) {
   deviceMockInstance.set_input_name(index, name);
 }
 
-void Device::set_output_name(uint8_t index, const std::string& name) {
+void Device::set_output_name(uint16_t index, const std::string& name) {
   deviceMockInstance.set_output_name(index, name);
 }
 
-void Device::open(const std::string& port_name) {
-  deviceMockInstance.open(port_name);
+void Device::open(const std::string& port_name,
+                  unsigned int baud_rate,
+                  bool negotiate_baud_rate) {
+  deviceMockInstance.open(port_name, baud_rate, negotiate_baud_rate);
 }
 
 void Device::close() {
   deviceMockInstance.close();
 }
 
+void Device::set_trace(SerialTrace* trace) {
+  deviceMockInstance.set_trace(trace);
+}
+
+void Device::set_synchronized_names(uint16_t inputs, uint16_t outputs) {
+  deviceMockInstance.set_synchronized_names(inputs, outputs);
+}
+
+void Device::set_name_verification(NameVerification verification) {
+  deviceMockInstance.set_name_verification(verification);
+}
+
 void Device::initialize() {
   deviceMockInstance.initialize();
 }
@@ -8,25 +8,45 @@ class DeviceMock {
              void(Device* self,
                   boost::asio::io_service& io_service));
 
-  MAKE_MOCK0(get_number_of_virtual_inputs, uint8_t());
+  MAKE_MOCK0(get_number_of_virtual_inputs, uint16_t());
 
-  MAKE_MOCK0(get_number_of_virtual_outputs, uint8_t());
+  MAKE_MOCK0(get_number_of_virtual_outputs, uint16_t());
 
   MAKE_MOCK2(tie, void(unsigned int input, unsigned int output));
 
+  MAKE_MOCK1(tie_multiple,
+             void(const std::vector<unsigned int>& input_of_output));
+
   MAKE_MOCK1(store, void(unsigned int index));
 
   MAKE_MOCK1(recall, void(unsigned int index));
 
-  MAKE_MOCK2(set_input_name, void(uint8_t index, const std::string& name));
+  MAKE_MOCK2(set_input_name, void(uint16_t index, const std::string& name));
 
-  MAKE_MOCK2(set_output_name, void(uint8_t index, const std::string& name));
+  MAKE_MOCK2(set_output_name, void(uint16_t index, const std::string& name));
 
-  MAKE_MOCK1(open, void(const std::string& port_name));
+  MAKE_MOCK3(open,
+             void(const std::string& port_name,
+                  unsigned int baud_rate,
+                  bool negotiate_baud_rate));
 
   MAKE_MOCK0(close, void());
 
+  MAKE_MOCK1(set_trace, void(SerialTrace* trace));
+
+  MAKE_MOCK2(set_synchronized_names, void(uint16_t inputs, uint16_t outputs));
+
+  MAKE_MOCK1(set_name_verification,
+             void(Device::NameVerification verification));
+
   MAKE_MOCK0(initialize, void());
+
+  MAKE_CONST_MOCK0(get_statistics, const DeviceStatistics&());
+
+  MAKE_CONST_MOCK1(get_outputs_of_input,
+                   const Device::OutputSet&(uint16_t input));
+
+  MAKE_CONST_MOCK1(count_outputs_of_input, uint16_t(uint16_t input));
 };
 
 extern DeviceMock deviceMockInstance;
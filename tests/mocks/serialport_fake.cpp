@@ -0,0 +1,109 @@
+#include "serialport_fake.h"
+
+#include <algorithm>
+#include <thread>
+
+SerialPortFake serialPortFakeInstance;
+
+void SerialPortFake::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  written.clear();
+  // Writes must not allocate, so the requests are collected in reserved space.
+  written.reserve(1 << 16);
+  respond = nullptr;
+  open = false;
+  baud_rate = 0;
+  port = nullptr;
+  read_handler = nullptr;
+  input.clear();
+}
+
+bool SerialPortFake::pump() {
+  bool busy = false;
+  std::string request;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    request = written;
+    written.clear();
+  }
+  if (!request.empty()) {
+    if (respond)
+      receive(respond(request));
+    busy = true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (read_handler && !input.empty() && port) {
+    const size_t size = std::min(read_buffer.size(), input.size());
+    std::copy_n(input.begin(), size, static_cast<char*>(read_buffer.data()));
+    input.erase(0, size);
+
+    auto handler = std::move(read_handler);
+    read_handler = nullptr;
+    boost::asio::post(port->get_executor(), [handler, size]() {
+      handler(boost::system::error_code(), size);
+    });
+    busy = true;
+  }
+  return busy;
+}
+
+void SerialPortFake::receive(const std::string& data) {
+  std::lock_guard<std::mutex> lock(mutex);
+  input += data;
+}
+
+bool SerialPortFake::idle() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return written.empty() && input.empty() && read_handler;
+}
+
+void SerialPortFake::pumpUntilIdle() {
+  while (!idle()) {
+    if (!pump())
+      std::this_thread::yield();
+  }
+}
+
+SerialPort::SerialPort(boost::asio::io_service& io_service)
+    : port(io_service) {}
+
+void SerialPort::open(const std::string& /*port_name*/,
+                      unsigned int baud_rate) {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  serialPortFakeInstance.open = true;
+  serialPortFakeInstance.baud_rate = baud_rate;
+  serialPortFakeInstance.port = this;
+}
+
+void SerialPort::set_baud_rate(unsigned int baud_rate) {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  serialPortFakeInstance.baud_rate = baud_rate;
+}
+
+void SerialPort::close() {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  serialPortFakeInstance.open = false;
+  serialPortFakeInstance.read_handler = nullptr;
+}
+
+bool SerialPort::is_open() const {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  return serialPortFakeInstance.open;
+}
+
+void SerialPort::write(const char* data, std::size_t size) {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  serialPortFakeInstance.written.append(data, size);
+}
+
+void SerialPort::async_read_some(const boost::asio::mutable_buffer& buffer,
+                                 ReadHandler handler) {
+  std::lock_guard<std::mutex> lock(serialPortFakeInstance.mutex);
+  serialPortFakeInstance.read_buffer = buffer;
+  serialPortFakeInstance.read_handler = std::move(handler);
+}
+
+boost::asio::serial_port::executor_type SerialPort::get_executor() {
+  return port.get_executor();
+}
@@ -0,0 +1,51 @@
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "serialport.h"
+
+// In-memory replacement for the serial port. Written requests are collected
+// until pump() passes them to respond and feeds the returned bytes to the
+// pending read. The port may be used from the io service thread while the
+// test pumps.
+class SerialPortFake {
+ public:
+  // Forget all state of a previous test.
+  void reset();
+
+  // Pass the written bytes to respond and deliver its result. Returns whether
+  // anything was written or delivered.
+  bool pump();
+
+  // Make bytes available for reading.
+  void receive(const std::string& data);
+
+  // Whether every request was answered and all responses were read.
+  bool idle();
+
+  // Pump until idle.
+  void pumpUntilIdle();
+
+  std::mutex mutex;
+
+  // Bytes written since the last pump().
+  std::string written;
+
+  // Device behind the port, gets every write and returns the response.
+  std::function<std::string(const std::string& request)> respond;
+
+  bool open{false};
+
+  // Bits per second the port was opened with or changed to.
+  unsigned int baud_rate{0};
+
+  // Pending read.
+  SerialPort* port{nullptr};
+  boost::asio::mutable_buffer read_buffer;
+  SerialPort::ReadHandler read_handler;
+
+  // Bytes received but not read yet.
+  std::string input;
+};
+
+extern SerialPortFake serialPortFakeInstance;
@@ -0,0 +1,69 @@
+#include "steadyclock_fake.h"
+
+#include <algorithm>
+
+SteadyClockFake steadyClockFakeInstance;
+
+void SteadyClockFake::reset() {
+  now = SteadyClock::time_point();
+  next_expiry = SteadyClock::time_point::max();
+}
+
+SteadyClock::time_point SteadyClock::now() noexcept {
+  return steadyClockFakeInstance.now;
+}
+
+SteadyClock::duration SteadyClock::to_wait_duration(const duration& d) {
+  // The io service asks before blocking how long the earliest timer has left.
+  // Remember when that is for advance(). Expired timers are handled right
+  // away, so there is nothing to remember.
+  if (d <= duration::zero())
+    return duration::zero();
+
+  const time_point expiry = steadyClockFakeInstance.now.load() + d;
+  time_point next = steadyClockFakeInstance.next_expiry;
+  while (expiry < next &&
+         !steadyClockFakeInstance.next_expiry.compare_exchange_weak(next,
+                                                                    expiry)) {
+  }
+  // Waiting in real time is pointless, but harmless: set_time() wakes the io
+  // service up whenever the virtual time moves.
+  return d;
+}
+
+VirtualIoService::VirtualIoService() : work(*this), wakeup(*this) {
+  steadyClockFakeInstance.reset();
+}
+
+std::size_t VirtualIoService::poll() {
+  // Handlers may start timers which already expired, which are only handled
+  // by the next poll.
+  std::size_t count = 0;
+  while (const std::size_t polled = boost::asio::io_service::poll())
+    count += polled;
+  return count;
+}
+
+void VirtualIoService::advance(SteadyClock::duration duration) {
+  const SteadyClock::time_point end = steadyClockFakeInstance.now.load() +
+                                      duration;
+  poll();
+  for (;;) {
+    const SteadyClock::time_point next = steadyClockFakeInstance.next_expiry;
+    if (next > end)
+      break;
+    set_time(std::max(next, steadyClockFakeInstance.now.load()));
+  }
+  set_time(end);
+}
+
+void VirtualIoService::set_time(SteadyClock::time_point time) {
+  steadyClockFakeInstance.now = time;
+  steadyClockFakeInstance.next_expiry = SteadyClock::time_point::max();
+
+  // A timer which expires before all others makes the io service check all
+  // its timers and report the next expiry again.
+  wakeup.expires_at(SteadyClock::time_point::min());
+  wakeup.async_wait([](const boost::system::error_code&) {});
+  poll();
+}
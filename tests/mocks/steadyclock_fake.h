@@ -0,0 +1,45 @@
+#include <atomic>
+
+#include <boost/asio/io_service.hpp>
+
+#include "steadyclock.h"
+
+// Virtual time for SteadyClock. It only moves when a test advances it, so
+// timeouts fire exactly when expected, no matter how slow the machine is.
+class SteadyClockFake {
+ public:
+  // Start again at time zero without pending timers.
+  void reset();
+
+  std::atomic<SteadyClock::time_point> now;
+
+  // Earliest expiry of a pending timer the io service has reported since it
+  // was reset to time_point::max(). May belong to a timer which was cancelled
+  // in the meantime.
+  std::atomic<SteadyClock::time_point> next_expiry;
+};
+
+extern SteadyClockFake steadyClockFakeInstance;
+
+// io service for timing tests. Its handlers only run while the test polls or
+// advances the virtual time, which lets the timers of a Device constructed
+// with it expire in order, one after the other.
+class VirtualIoService : public boost::asio::io_service {
+ public:
+  VirtualIoService();
+
+  // Run all handlers which are ready at the current virtual time. Returns the
+  // number of handlers run.
+  std::size_t poll();
+
+  // Move the virtual time forward by duration, stopping at every timer expiry
+  // on the way to run its handlers.
+  void advance(SteadyClock::duration duration);
+
+ private:
+  // Set the virtual time and let the io service check its timers.
+  void set_time(SteadyClock::time_point time);
+
+  boost::asio::io_service::work work;
+  SteadyTimer wakeup;
+};
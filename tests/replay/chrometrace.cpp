@@ -0,0 +1,204 @@
+#include "chrometrace.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace {
+const int simulationThread = 1;
+const int serialPortThread = 2;
+
+//! Part of the lifecycle of a request which is open in the timeline.
+enum class Stage
+{
+  None,
+  Queued,
+  Waiting,
+  Receiving,
+};
+
+struct OpenRequest
+{
+  std::string name;
+  Stage stage = Stage::None;
+};
+
+std::string Escape(const std::string& text)
+{
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20 ||
+               static_cast<unsigned char>(c) >= 0x7F) {
+      // Names may be Latin-1, which JSON does not allow unescaped.
+      char code[7];
+      std::snprintf(
+        code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+const char* NameOf(Stage stage)
+{
+  switch (stage) {
+    case Stage::Queued:
+      return "queued";
+    case Stage::Waiting:
+      return "waiting";
+    case Stage::Receiving:
+      return "receiving";
+    default:
+      return "";
+  }
+}
+
+class Writer
+{
+public:
+  explicit Writer(std::ostream& out)
+    : out(out)
+  {}
+
+  //! Start an event with the fields all events have.
+  void Begin(const std::string& name,
+             const char* phase,
+             int thread,
+             int64_t time)
+  {
+    out << (first ? "\n" : ",\n") << "{\"name\":\"" << Escape(name)
+        << "\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << thread;
+    char timestamp[32];
+    std::snprintf(timestamp, sizeof(timestamp), "%.3f", time / 1000.0);
+    out << ",\"ts\":" << timestamp;
+    first = false;
+  }
+
+  //! Start an event of the asynchronous slices of a request.
+  void BeginAsync(const std::string& name,
+                  const char* phase,
+                  const SerialTrace::Event& event)
+  {
+    Begin(name, phase, serialPortThread, event.time);
+    out << ",\"cat\":\"request\",\"id\":" << event.request;
+  }
+
+  void End() { out << "}"; }
+
+  void EndWithArgument(const char* name, const std::string& value)
+  {
+    out << ",\"args\":{\"" << name << "\":\"" << Escape(value) << "\"}}";
+  }
+
+  void ThreadName(int thread, const char* name)
+  {
+    out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\","
+        << "\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":\"" << name
+        << "\"}}";
+    first = false;
+  }
+
+  //! End the open stage of a request and begin the next one.
+  void Enter(OpenRequest& request,
+             Stage stage,
+             const SerialTrace::Event& event)
+  {
+    if (request.stage != Stage::None) {
+      BeginAsync(NameOf(request.stage), "e", event);
+      End();
+    }
+    request.stage = stage;
+    if (stage != Stage::None) {
+      BeginAsync(NameOf(stage), "b", event);
+      End();
+    }
+  }
+
+private:
+  std::ostream& out;
+  bool first = true;
+};
+} // namespace
+
+void WriteChromeTrace(const std::vector<SerialTrace::Event>& events,
+                      std::ostream& out)
+{
+  using Kind = SerialTrace::Kind;
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  Writer writer(out);
+  writer.ThreadName(simulationThread, "CCalculateEx");
+  writer.ThreadName(serialPortThread, "Serial port");
+
+  std::map<uint32_t, OpenRequest> requests;
+  auto open = [&](const SerialTrace::Event& event) -> OpenRequest& {
+    auto it = requests.find(event.request);
+    if (it == requests.end()) {
+      // The request was queued before the trace begins.
+      it = requests.emplace(event.request, OpenRequest()).first;
+      it->second.name = "request " + std::to_string(event.request);
+      writer.BeginAsync(it->second.name, "b", event);
+      writer.End();
+    }
+    return it->second;
+  };
+
+  for (const SerialTrace::Event& event : events) {
+    switch (event.kind) {
+      case Kind::StepBegin:
+        writer.Begin("step", "B", simulationThread, event.time);
+        writer.End();
+        break;
+      case Kind::StepEnd:
+        writer.Begin("step", "E", simulationThread, event.time);
+        writer.End();
+        break;
+      case Kind::Enqueued: {
+        OpenRequest& request = requests[event.request];
+        request.name = event.data;
+        writer.BeginAsync(request.name, "b", event);
+        writer.EndWithArgument("type", std::to_string(event.type));
+        writer.Enter(request, Stage::Queued, event);
+        break;
+      }
+      case Kind::Promoted:
+        writer.Enter(open(event), Stage::None, event);
+        break;
+      case Kind::Sent:
+        writer.Begin("write", "i", serialPortThread, event.time);
+        out << ",\"s\":\"t\"";
+        writer.EndWithArgument("data", event.data);
+        writer.Enter(open(event), Stage::Waiting, event);
+        break;
+      case Kind::FirstByte: {
+        auto it = requests.find(event.request);
+        if (it != requests.end() && it->second.stage == Stage::Waiting)
+          writer.Enter(it->second, Stage::Receiving, event);
+        break;
+      }
+      case Kind::Received:
+        writer.Begin("read", "i", serialPortThread, event.time);
+        out << ",\"s\":\"t\"";
+        writer.EndWithArgument("data", event.data);
+        break;
+      case Kind::Completed: {
+        OpenRequest& request = open(event);
+        writer.Enter(request, Stage::None, event);
+        writer.BeginAsync(request.name, "e", event);
+        writer.EndWithArgument("result",
+                               event.data.empty() ? "ok" : event.data);
+        requests.erase(event.request);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  out << "\n]}\n";
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "serialtrace.h"
+
+/**
+ * @brief Write the events of a trace in the Chrome trace event format, which
+ * Perfetto and chrome://tracing can show as timeline.
+ *
+ * Every request becomes an asynchronous slice from being queued to its
+ * completion, nested into the time it was queued, waited for the first byte
+ * of the response and received the response. The simulation steps become
+ * slices of their own thread, the sent requests and received lines instant
+ * events of the serial port.
+ */
+void WriteChromeTrace(const std::vector<SerialTrace::Event>& events,
+                      std::ostream& out);
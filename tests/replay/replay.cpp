@@ -0,0 +1,53 @@
+// Replays a serial trace recorded by the DLL against the protocol engine.
+//
+// Prints one JSON object with the result and exits with 1 if the requests sent
+// by the protocol engine differ from the recorded ones, so recorded traffic
+// can serve as regression test. Usage: Extron-Matrix_Replay <trace file>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "serialtrace.h"
+#include "tracereplay.h"
+
+namespace {
+double Milliseconds(std::chrono::nanoseconds duration)
+{
+  return duration.count() / 1e6;
+}
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <trace file>" << std::endl;
+    return 2;
+  }
+
+  std::vector<SerialTrace::Event> events;
+  if (!SerialTrace::read(argv[1], events)) {
+    std::cerr << "Unable to read the trace " << argv[1] << "." << std::endl;
+    return 2;
+  }
+
+  TraceReplay replay(std::move(events));
+  const TraceReplay::Report report = replay.Run();
+
+  if (report.mismatches > 0)
+    std::cerr << report.firstMismatch << std::endl;
+
+  const double meanProcessing =
+    report.lines > 0 ? Milliseconds(report.processing) / report.lines : 0.0;
+  std::cout << "{\"lines\":" << report.lines
+            << ",\"requests\":" << report.requests
+            << ",\"mismatches\":" << report.mismatches
+            << ",\"trace_ms\":" << Milliseconds(report.traceDuration)
+            << ",\"processing_ms\":" << Milliseconds(report.processing)
+            << ",\"mean_processing_ms\":" << meanProcessing
+            << ",\"max_processing_ms\":" << Milliseconds(report.maxProcessing)
+            << ",\"max_queue_depth\":" << report.maxQueueDepth
+            << ",\"dropped\":" << report.dropped << "}" << std::endl;
+
+  return report.mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+// Converts a serial trace recorded by the DLL into the Chrome trace event
+// format, which can be opened with Perfetto or chrome://tracing.
+// Usage: Extron-Matrix_TraceExport <trace file> [<json file>]
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "chrometrace.h"
+#include "serialtrace.h"
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2 && argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <trace file> [<json file>]"
+              << std::endl;
+    return 2;
+  }
+
+  std::vector<SerialTrace::Event> events;
+  if (!SerialTrace::read(argv[1], events)) {
+    std::cerr << "Unable to read the trace " << argv[1] << "." << std::endl;
+    return 2;
+  }
+
+  if (argc == 2) {
+    WriteChromeTrace(events, std::cout);
+    return 0;
+  }
+
+  std::ofstream out(argv[2]);
+  WriteChromeTrace(events, out);
+  if (!out) {
+    std::cerr << "Unable to write " << argv[2] << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,248 @@
+#include "tracereplay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <regex>
+
+#include "device.h"
+#include "serialport_fake.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using RequestType = Device::RequestType;
+
+RequestType TypeOf(const SerialTrace::Event& event)
+{
+  return static_cast<RequestType>(event.type);
+}
+
+//! Exchange requests and responses until Device is idle.
+void Settle(boost::asio::io_service& io_service)
+{
+  do {
+    io_service.poll();
+  } while (serialPortFakeInstance.pump());
+}
+
+std::string Printable(const std::string& data)
+{
+  std::string text;
+  for (char c : data) {
+    if (c == '\x1B')
+      text += "\\e";
+    else if (c == '\r')
+      text += "\\r";
+    else
+      text += c;
+  }
+  return text;
+}
+} // namespace
+
+TraceReplay::TraceReplay(std::vector<SerialTrace::Event> events)
+  : events(std::move(events))
+{}
+
+TraceReplay::Report TraceReplay::Run()
+{
+  Report report;
+  nextSent = 0;
+  sent.clear();
+  inputOfOutput.clear();
+  if (events.empty())
+    return report;
+
+  report.traceDuration =
+    std::chrono::nanoseconds(events.back().time - events.front().time);
+  report.requests = static_cast<size_t>(
+    std::count_if(events.begin(), events.end(), [](const auto& event) {
+      return event.kind == SerialTrace::Kind::Sent;
+    }));
+
+  boost::asio::io_service io_service;
+  serialPortFakeInstance.reset();
+  serialPortFakeInstance.respond = [this](const std::string& request) {
+    sent += request;
+    return std::string();
+  };
+
+  Device device(io_service);
+  device.connectedCallback = []() {};
+  device.setupCallback = [this, &device]() {
+    inputOfOutput.assign(device.get_number_of_virtual_outputs(), 0);
+  };
+  device.tieChanged = [this](uint16_t out, uint16_t in) {
+    if (out >= 1 && out <= inputOfOutput.size())
+      inputOfOutput[out - 1] = in;
+  };
+  device.tieFailed = [](uint16_t) {};
+  device.inputNameChanged = [](uint16_t, std::string) {};
+  device.outputNameChanged = [](uint16_t, std::string) {};
+  device.reportError = [](const std::string&) {};
+
+  device.open("REPLAY");
+  Settle(io_service);
+
+  std::vector<bool> issued(events.size(), false);
+  for (size_t i = 0; i < events.size(); ++i) {
+    const SerialTrace::Event& event = events[i];
+
+    if (event.kind == SerialTrace::Kind::Sent) {
+      if (IsIssued(event) && !issued[i]) {
+        Issue(device, event);
+        issued[i] = true;
+        Settle(io_service);
+      }
+    } else if (event.kind == SerialTrace::Kind::Received) {
+      // When other requests are waiting, the requests sent after this line
+      // must have been queued while it was awaited, so queue them before
+      // feeding it. Else they are issued once Device is idle again, like they
+      // were originally, so the scheduler makes the same decisions.
+      const bool queued = device.get_statistics().get_queue_depth() > 0;
+      for (size_t j = i + 1; queued && j < events.size(); ++j) {
+        if (events[j].kind == SerialTrace::Kind::Received)
+          break;
+        if (IsIssued(events[j]) && !issued[j]) {
+          Issue(device, events[j]);
+          issued[j] = true;
+        }
+      }
+      report.maxQueueDepth = std::max(
+        report.maxQueueDepth, device.get_statistics().get_queue_depth());
+
+      serialPortFakeInstance.receive(event.data + "\r\n");
+      const Clock::time_point start = Clock::now();
+      Settle(io_service);
+      const auto duration = Clock::now() - start;
+
+      ++report.lines;
+      report.processing += duration;
+      report.maxProcessing = std::max(
+        report.maxProcessing,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+    }
+
+    report.maxQueueDepth = std::max(report.maxQueueDepth,
+                                    device.get_statistics().get_queue_depth());
+    CompareSent(report, false);
+  }
+  CompareSent(report, true);
+
+  report.dropped = device.get_statistics().get_dropped();
+  device.close();
+  io_service.poll();
+  return report;
+}
+
+void TraceReplay::Issue(Device& device, const SerialTrace::Event& event)
+{
+  const std::string& data = event.data;
+  unsigned int index = 0;
+  unsigned int output = 0;
+  switch (TypeOf(event)) {
+    case RequestType::Tie:
+      if (std::sscanf(data.c_str(), "%u*%u!", &index, &output) == 2)
+        device.tie(index, output);
+      break;
+    case RequestType::MultiTie: {
+      static const std::regex tie("([0-9]+)\\*([0-9]+)!");
+      std::vector<unsigned int> ties = inputOfOutput;
+      for (std::sregex_iterator it(data.begin(), data.end(), tie), end;
+           it != end;
+           ++it) {
+        output = static_cast<unsigned int>(std::stoul(it->str(2)));
+        if (output >= 1 && output <= ties.size())
+          ties[output - 1] = static_cast<unsigned int>(std::stoul(it->str(1)));
+      }
+      device.tie_multiple(ties);
+      break;
+    }
+    case RequestType::TieAll:
+      if (std::sscanf(data.c_str(), "%u*!", &index) == 1)
+        device.tie_multiple(
+          std::vector<unsigned int>(inputOfOutput.size(), index));
+      break;
+    case RequestType::Store:
+      if (std::sscanf(data.c_str(), "%u,", &index) == 1)
+        device.store(index);
+      break;
+    case RequestType::Recall:
+      if (std::sscanf(data.c_str(), "%u.", &index) == 1)
+        device.recall(index);
+      break;
+    case RequestType::WriteVirtualInputName:
+    case RequestType::WriteVirtualOutputName: {
+      // \x1BnI<index>,<name>\r
+      const size_t comma = data.find(',');
+      if (data.size() < 4 || comma == std::string::npos)
+        break;
+      index = static_cast<unsigned int>(std::stoul(data.substr(3, comma - 3)));
+      const std::string name =
+        data.substr(comma + 1, data.size() - comma - 2);
+      if (TypeOf(event) == RequestType::WriteVirtualInputName)
+        device.set_input_name(static_cast<uint16_t>(index), name);
+      else
+        device.set_output_name(static_cast<uint16_t>(index), name);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+bool TraceReplay::IsIssued(const SerialTrace::Event& event)
+{
+  if (event.kind != SerialTrace::Kind::Sent)
+    return false;
+
+  switch (TypeOf(event)) {
+    case RequestType::Tie:
+    case RequestType::MultiTie:
+    case RequestType::TieAll:
+    case RequestType::Store:
+    case RequestType::Recall:
+    case RequestType::WriteVirtualInputName:
+    case RequestType::WriteVirtualOutputName:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void TraceReplay::CompareSent(Report& report, bool complete)
+{
+  for (; nextSent < events.size(); ++nextSent) {
+    const SerialTrace::Event& event = events[nextSent];
+    if (event.kind != SerialTrace::Kind::Sent)
+      continue;
+
+    const std::string& expected = event.data;
+    if (sent.size() < expected.size() &&
+        sent.compare(0, sent.size(), expected, 0, sent.size()) == 0) {
+      // The request was not sent completely yet.
+      if (!complete)
+        return;
+      Mismatch(report, "Missing request " + Printable(expected) + ".");
+      sent.clear();
+      continue;
+    }
+
+    if (sent.compare(0, expected.size(), expected) != 0)
+      Mismatch(report,
+               "Expected request " + Printable(expected) + " but got " +
+                 Printable(sent.substr(0, expected.size())) + ".");
+    sent.erase(0, expected.size());
+  }
+
+  if (complete && !sent.empty()) {
+    Mismatch(report, "Unexpected requests " + Printable(sent) + ".");
+    sent.clear();
+  }
+}
+
+void TraceReplay::Mismatch(Report& report, const std::string& description)
+{
+  if (report.mismatches == 0)
+    report.firstMismatch = description;
+  ++report.mismatches;
+}
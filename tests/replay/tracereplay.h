@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "serialtrace.h"
+
+class Device;
+
+/**
+ * @brief Replays a recorded serial trace against Device.
+ *
+ * The received lines of the trace are fed into Device through the fake serial
+ * port and the requests Device sends are compared with the recorded ones.
+ * Requests which were caused by the simulation, like ties and names, are
+ * issued by calling Device when it sends them or, if other requests are
+ * queued, right before the line which let the device send them. The replay
+ * does not wait between the events, the timestamps of the trace only serve as
+ * virtual clock for the report.
+ *
+ * The trace must begin with the opening of the port, which is the case as
+ * long as the ring file did not overflow.
+ */
+class TraceReplay
+{
+public:
+  struct Report
+  {
+    //! Received lines fed into Device.
+    size_t lines = 0;
+    //! Requests which were recorded as sent.
+    size_t requests = 0;
+    //! Requests which differ from the recorded ones or are missing.
+    size_t mismatches = 0;
+    //! Description of the first mismatch.
+    std::string firstMismatch;
+    //! Time between the first and the last event of the trace.
+    std::chrono::nanoseconds traceDuration{ 0 };
+    //! Time Device spent reading and processing the received lines.
+    std::chrono::nanoseconds processing{ 0 };
+    //! Longest time Device spent on a single line.
+    std::chrono::nanoseconds maxProcessing{ 0 };
+    //! Largest number of requests which were waiting in the queues.
+    size_t maxQueueDepth = 0;
+    //! Requests dropped because their queue was full.
+    uint64_t dropped = 0;
+  };
+
+  explicit TraceReplay(std::vector<SerialTrace::Event> events);
+
+  Report Run();
+
+private:
+  //! Issue the request of a sent event by calling Device.
+  void Issue(Device& device, const SerialTrace::Event& event);
+
+  //! Whether a request is sent because Device was asked to.
+  static bool IsIssued(const SerialTrace::Event& event);
+
+  //! Compare the bytes Device sent with the recorded requests.
+  void CompareSent(Report& report, bool complete);
+
+  void Mismatch(Report& report, const std::string& description);
+
+  std::vector<SerialTrace::Event> events;
+  //! Index of the next sent event to compare.
+  size_t nextSent = 0;
+  //! Bytes Device sent which were not compared yet.
+  std::string sent;
+  std::vector<unsigned int> inputOfOutput;
+};
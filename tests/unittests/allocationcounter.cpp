@@ -0,0 +1,34 @@
+#include "allocationcounter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions of the test executable to count
+// the allocations of each thread.
+
+namespace {
+thread_local size_t allocations = 0;
+}
+
+size_t allocationCount()
+{
+  return allocations;
+}
+
+void* operator new(size_t size)
+{
+  ++allocations;
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
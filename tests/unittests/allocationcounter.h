@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stddef.h>
+
+//! Number of heap allocations the calling thread made so far.
+size_t allocationCount();
@@ -0,0 +1,101 @@
+#include <catch.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chrometrace.h"
+
+namespace {
+using Kind = SerialTrace::Kind;
+
+SerialTrace::Event Event(int64_t microseconds,
+                         Kind kind,
+                         uint32_t request,
+                         const std::string& data = "")
+{
+  return { microseconds * 1000, kind, 5, request, data };
+}
+
+bool Contains(const std::string& text, const std::string& part)
+{
+  return text.find(part) != std::string::npos;
+}
+} // namespace
+
+SCENARIO("exporting a trace as Chrome trace", "[chrometrace]") {
+  GIVEN("The lifecycle of a tie during a simulation step") {
+    const std::vector<SerialTrace::Event> events{
+      Event(0, Kind::StepBegin, 1),
+      Event(1, Kind::Enqueued, 7, "3*2!"),
+      Event(2, Kind::StepEnd, 1),
+      Event(3, Kind::Promoted, 7),
+      Event(3, Kind::Sent, 7, "3*2!"),
+      Event(10, Kind::FirstByte, 7),
+      Event(12, Kind::Received, 7, "Out02 In03 All"),
+      Event(12, Kind::Completed, 7),
+    };
+
+    WHEN("exporting it") {
+      std::ostringstream out;
+      WriteChromeTrace(events, out);
+      const std::string json = out.str();
+
+      THEN("The step is a slice of the simulation thread") {
+        REQUIRE(Contains(
+          json, R"({"name":"step","ph":"B","pid":1,"tid":1,"ts":0.000})"));
+        REQUIRE(Contains(
+          json, R"({"name":"step","ph":"E","pid":1,"tid":1,"ts":2.000})"));
+      }
+
+      THEN("The request is a slice from queueing to completion") {
+        REQUIRE(Contains(json,
+                         R"({"name":"3*2!","ph":"b","pid":1,"tid":2,)"
+                         R"("ts":1.000,"cat":"request","id":7,)"
+                         R"("args":{"type":"5"}})"));
+        REQUIRE(Contains(json,
+                         R"({"name":"3*2!","ph":"e","pid":1,"tid":2,)"
+                         R"("ts":12.000,"cat":"request","id":7,)"
+                         R"("args":{"result":"ok"}})"));
+      }
+
+      THEN("The stages of the request are nested slices") {
+        REQUIRE(Contains(json, R"({"name":"queued","ph":"b","pid":1,"tid":2,)"
+                               R"("ts":1.000,"cat":"request","id":7})"));
+        REQUIRE(Contains(json, R"({"name":"queued","ph":"e","pid":1,"tid":2,)"
+                               R"("ts":3.000,"cat":"request","id":7})"));
+        REQUIRE(Contains(json, R"({"name":"waiting","ph":"b","pid":1,)"
+                               R"("tid":2,"ts":3.000,"cat":"request",)"
+                               R"("id":7})"));
+        REQUIRE(Contains(json, R"({"name":"waiting","ph":"e","pid":1,)"
+                               R"("tid":2,"ts":10.000,"cat":"request",)"
+                               R"("id":7})"));
+        REQUIRE(Contains(json, R"({"name":"receiving","ph":"e","pid":1,)"
+                               R"("tid":2,"ts":12.000,"cat":"request",)"
+                               R"("id":7})"));
+      }
+
+      THEN("The received line is an instant event") {
+        REQUIRE(Contains(json,
+                         R"({"name":"read","ph":"i","pid":1,"tid":2,)"
+                         R"("ts":12.000,"s":"t",)"
+                         R"("args":{"data":"Out02 In03 All"}})"));
+      }
+    }
+  }
+
+  GIVEN("A request with control characters and Latin-1 text") {
+    const std::vector<SerialTrace::Event> events{
+      Event(0, Kind::Enqueued, 1, "\x1BnO1,Caf\xE9\r"),
+    };
+
+    WHEN("exporting it") {
+      std::ostringstream out;
+      WriteChromeTrace(events, out);
+
+      THEN("They are escaped") {
+        REQUIRE(Contains(out.str(), R"("name":"\u001bnO1,Caf\u00e9\u000d")"));
+      }
+    }
+  }
+}
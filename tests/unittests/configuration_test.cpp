@@ -32,13 +32,28 @@ SCENARIO("serialization of the configuration", "[configuration]") {
   }
 
   GIVEN("A serialized configuration") {
-    std::array<unsigned char, 1 + 5 + 2 * 4 + 2> data{
+    std::array<unsigned char,
+               1 + 5 + 2 * 4 + 3 + 6 + 1 + 1 + 6 + 4 + 1 + 1 + 1 + 1 + 1>
+      data{
       0x01,                         // present
       'C',  'O',  'M',  '7',  0x00, // com port
       0x05, 0x00, 0x00, 0x00,       // inputs
       0x03, 0x00, 0x00, 0x00,       // inputs
       0x01,                         // include input names
-      0x00                          // include output names
+      0x00,                         // include output names
+      0x01,                         // staged routing
+      'a',  '.',  'b',  'i',  'n',  // preset file
+      0x00,
+      0x01,                         // optimistic ties
+      0x01,                         // statistics pins
+      't',  '.',  't',  'r',  'c',  // trace file
+      0x00,
+      0x00, 0xC2, 0x01, 0x00,       // baud rate
+      0x01,                         // negotiate baud rate
+      0x01,                         // compact pins
+      0x01,                         // $MAP pins
+      0x01,                         // tally pins
+      0x02                          // name verification
     };
 
     double* PUser = reinterpret_cast<double*>(data.data());
@@ -53,18 +68,85 @@ SCENARIO("serialization of the configuration", "[configuration]") {
         REQUIRE(configuration.outputs == 3);
         REQUIRE(configuration.includeInputNames == true);
         REQUIRE(configuration.includeOutputNames == false);
+        REQUIRE(configuration.stagedRouting == true);
+        REQUIRE(configuration.presetFile == "a.bin");
+        REQUIRE(configuration.optimisticTies == true);
+        REQUIRE(configuration.statisticsPins == true);
+        REQUIRE(configuration.traceFile == "t.trc");
+        REQUIRE(configuration.baudRate == 115200);
+        REQUIRE(configuration.negotiateBaudRate == true);
+        REQUIRE(configuration.compactPins == true);
+        REQUIRE(configuration.mapPins == true);
+        REQUIRE(configuration.tallyPins == true);
+        REQUIRE(configuration.nameVerification == 2);
+      }
+    }
+  }
+
+  GIVEN("A configuration stored before the baud rate was configurable") {
+    std::array<unsigned char,
+               1 + 5 + 2 * 4 + 3 + 6 + 1 + 1 + 6 + 4 + 1 + 1 + 1 + 1 + 1>
+      data{
+      0x01,                         // present
+      'C',  'O',  'M',  '7',  0x00, // com port
+      0x05, 0x00, 0x00, 0x00,       // inputs
+      0x03, 0x00, 0x00, 0x00,       // inputs
+      0x00,                         // include input names
+      0x00,                         // include output names
+      0x00,                         // staged routing
+      'a',  '.',  'b',  'i',  'n',  // preset file
+      0x00,
+      0x00,                         // optimistic ties
+      0x00,                         // statistics pins
+      't',  '.',  't',  'r',  'c',  // trace file
+      0x00,
+      0x00, 0x00, 0x00, 0x00,       // zeroed by the older version
+      0x00,
+      0x00,
+      0x00,
+      0x00,
+      0x00
+    };
+
+    double* PUser = reinterpret_cast<double*>(data.data());
+
+    WHEN("deserializing the configuration") {
+      Configuration configuration(PUser);
+
+      THEN("The device is opened with 9600 baud") {
+        REQUIRE(configuration.baudRate == 9600);
+        REQUIRE(configuration.negotiateBaudRate == false);
+        REQUIRE(configuration.compactPins == false);
+        REQUIRE(configuration.mapPins == false);
+        REQUIRE(configuration.tallyPins == false);
+        REQUIRE(configuration.nameVerification == 0);
       }
     }
   }
 
   GIVEN("A configuration") {
-    std::array<unsigned char, 1 + 5 + 2 * 4 + 1 + 1> data{
+    std::array<unsigned char,
+               1 + 5 + 2 * 4 + 3 + 6 + 1 + 1 + 6 + 4 + 1 + 1 + 1 + 1 + 1>
+      data{
       0x00,                         // present
       0x00, 0x00, 0x00, 0x00, 0x00, // com port
       0x00, 0x00, 0x00, 0x00,       // inputs
       0x00, 0x00, 0x00, 0x00,       // inputs
       0x00,                         // include input names
-      0x00                          // include output names
+      0x00,                         // include output names
+      0x00,                         // staged routing
+      0x00, 0x00, 0x00, 0x00, 0x00, // preset file
+      0x00,
+      0x00,                         // optimistic ties
+      0x00,                         // statistics pins
+      0x00, 0x00, 0x00, 0x00, 0x00, // trace file
+      0x00,
+      0x00, 0x00, 0x00, 0x00,       // baud rate
+      0x00,                         // negotiate baud rate
+      0x00,                         // compact pins
+      0x00,                         // $MAP pins
+      0x00,                         // tally pins
+      0x00                          // name verification
     };
     double* PUser = reinterpret_cast<double*>(data.data());
 
@@ -75,15 +157,41 @@ SCENARIO("serialization of the configuration", "[configuration]") {
     configuration.outputs = 7;
     configuration.includeInputNames = true;
     configuration.includeOutputNames = true;
+    configuration.stagedRouting = false;
+    configuration.presetFile = "p.bin";
+    configuration.optimisticTies = true;
+    configuration.statisticsPins = true;
+    configuration.traceFile = "s.trc";
+    configuration.baudRate = 38400;
+    configuration.negotiateBaudRate = true;
+    configuration.compactPins = true;
+    configuration.mapPins = false;
+    configuration.tallyPins = true;
+    configuration.nameVerification = 1;
 
     WHEN("serializing the configuration") {
-      std::array<unsigned char, 1 + 5 + 2 * 4 + 1 + 1> expectedData{
+      std::array<unsigned char,
+                 1 + 5 + 2 * 4 + 3 + 6 + 1 + 1 + 6 + 4 + 1 + 1 + 1 + 1 + 1>
+        expectedData{
         0x01,                         // present
         'C',  'O',  'M',  '1',  0x00, // com port
         0x0A, 0x00, 0x00, 0x00,       // inputs
         0x07, 0x00, 0x00, 0x00,       // inputs
         0x01,                         // include input names
         0x01,                         // include output names
+        0x00,                         // staged routing
+        'p',  '.',  'b',  'i',  'n',  // preset file
+        0x00,
+        0x01,                         // optimistic ties
+        0x01,                         // statistics pins
+        's',  '.',  't',  'r',  'c',  // trace file
+        0x00,
+        0x00, 0x96, 0x00, 0x00,       // baud rate
+        0x01,                         // negotiate baud rate
+        0x01,                         // compact pins
+        0x00,                         // $MAP pins
+        0x01,                         // tally pins
+        0x01,                         // name verification
       };
 
       REQUIRE(configuration.Write());
@@ -113,3 +221,62 @@ SCENARIO("serialization of the configuration", "[configuration]") {
     }
   }
 }
+
+SCENARIO("Counting the pins of the configuration", "[configuration]") {
+  GIVEN("A configuration for a 128x128 matrix with all pins") {
+    Configuration configuration;
+    configuration.inputs = 128;
+    configuration.outputs = 128;
+    configuration.includeInputNames = true;
+    configuration.includeOutputNames = true;
+    configuration.stagedRouting = true;
+    configuration.optimisticTies = true;
+    configuration.statisticsPins = true;
+
+    THEN("Each output has an OUT pin") {
+      REQUIRE(configuration.RoutingPins() == 128);
+      REQUIRE(configuration.InputPins() == 133);
+      REQUIRE(configuration.OutputPins() == 140);
+    }
+
+    WHEN("Compact pins are used") {
+      configuration.compactPins = true;
+
+      THEN("Five outputs share an OUT pin") {
+        REQUIRE(configuration.RoutingPins() == 26);
+        REQUIRE(configuration.InputPins() == 31);
+        REQUIRE(configuration.OutputPins() == 38);
+      }
+    }
+
+    WHEN("$MAP pins are used") {
+      configuration.mapPins = true;
+
+      THEN("One string pin holds all outputs") {
+        REQUIRE(configuration.RoutingPins() == 1);
+        REQUIRE(configuration.InputPins() == 6);
+        REQUIRE(configuration.OutputPins() == 13);
+      }
+    }
+
+    WHEN("Tally pins are shown") {
+      configuration.tallyPins = true;
+
+      THEN("Each input has an output pin") {
+        REQUIRE(configuration.InputPins() == 133);
+        REQUIRE(configuration.OutputPins() == 268);
+      }
+    }
+  }
+
+  GIVEN("A configuration with more outputs than ProfiLab has pins") {
+    Configuration configuration;
+    configuration.outputs = 256;
+
+    THEN("Only compact pins fit") {
+      REQUIRE(configuration.OutputPins() > Configuration::max_pins);
+      configuration.compactPins = true;
+      REQUIRE(configuration.OutputPins() <= Configuration::max_pins);
+    }
+  }
+}
@@ -0,0 +1,535 @@
+#include <catch.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include "allocationcounter.h"
+#include "emulateddevice.h"
+#include "serialtrace.h"
+
+SCENARIO("Controlling an emulated matrix", "[device]") {
+  GIVEN("A connected device") {
+    EmulatedDevice emulated;
+    emulated.emulator.ties = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    THEN("The device is connected without errors") {
+      REQUIRE(emulated.connected);
+      REQUIRE(emulated.errors.empty());
+    }
+
+    WHEN("An input is tied to an output") {
+      emulated.device.tie(3, 2);
+      emulated.Run();
+
+      THEN("The matrix and the callback have the tie") {
+        REQUIRE(emulated.emulator.ties[1] == 3);
+        REQUIRE(emulated.inputOfOutput[1] == 3);
+        REQUIRE(emulated.errors.empty());
+      }
+
+      THEN("Every request got a response") {
+        const DeviceStatistics& statistics = emulated.device.get_statistics();
+        REQUIRE(statistics.get_requests() > 0);
+        REQUIRE(statistics.get_responses() == statistics.get_requests());
+        REQUIRE(statistics.get_errors() == 0);
+        REQUIRE(statistics.get_timeouts() == 0);
+        REQUIRE_FALSE(statistics.get_in_flight());
+      }
+    }
+
+    WHEN("An invalid tie is requested") {
+      emulated.device.tie(9, 2);
+      emulated.Run();
+
+      THEN("The tie fails") {
+        REQUIRE(emulated.failedTies == std::vector<uint16_t>{ 2 });
+        REQUIRE(emulated.errors.size() == 1);
+      }
+    }
+
+    WHEN("Multiple ties are requested") {
+      emulated.device.tie_multiple({ 8, 7, 6, 5, 4, 3, 2, 1 });
+      emulated.Run();
+
+      THEN("All of them are tied") {
+        const std::vector<unsigned int> expected{ 8, 7, 6, 5, 4, 3, 2, 1 };
+        REQUIRE(emulated.emulator.ties == expected);
+        REQUIRE(emulated.inputOfOutput == expected);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+
+    WHEN("An input is tied to all outputs") {
+      const DeviceStatistics& statistics = emulated.device.get_statistics();
+      const size_t requests = statistics.get_requests();
+      emulated.device.tie_multiple(std::vector<unsigned int>(8, 5));
+      emulated.Run();
+
+      THEN("A single tie to all outputs is sent") {
+        const std::vector<unsigned int> expected(8, 5);
+        REQUIRE(statistics.get_requests() == requests + 1);
+        REQUIRE(emulated.emulator.ties == expected);
+        REQUIRE(emulated.inputOfOutput == expected);
+        REQUIRE(emulated.device.count_outputs_of_input(5) == 8);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+
+    WHEN("The current routing is stored to a preset") {
+      const std::vector<unsigned int> stored{ 8, 7, 6, 5, 4, 3, 2, 1 };
+      emulated.device.tie_multiple(stored);
+      emulated.Run();
+      emulated.device.store(2);
+      emulated.Run();
+      emulated.device.tie_multiple(std::vector<unsigned int>(8, 1));
+      emulated.Run();
+      emulated.device.recall(2);
+      emulated.io_service.poll();
+
+      THEN("Recalling it publishes the routing before it is read") {
+        REQUIRE(emulated.inputOfOutput == stored);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+
+    WHEN("The matrix rejects storing a preset") {
+      const std::vector<unsigned int> stored{ 8, 7, 6, 5, 4, 3, 2, 1 };
+      emulated.device.tie_multiple(stored);
+      emulated.Run();
+      serialPortFakeInstance.respond = [](const std::string&) {
+        return std::string("E11\r\n");
+      };
+      emulated.device.store(2);
+      emulated.Run();
+
+      THEN("Recalling it does not publish the rejected routing") {
+        emulated.device.recall(2);
+        emulated.io_service.poll();
+        REQUIRE(emulated.inputOfOutput != stored);
+        REQUIRE(emulated.errors.size() == 1);
+      }
+    }
+
+    WHEN("A preset is recalled while a tie is in flight") {
+      const std::vector<unsigned int> preset{ 8, 7, 6, 5, 4, 3, 2, 1 };
+      emulated.emulator.presets[0] = preset;
+      // The second tie is taken from the queue, which starts a turn of the
+      // control requests.
+      emulated.device.tie(3, 2);
+      emulated.device.tie(4, 5);
+      emulated.Run();
+      emulated.device.tie(5, 6);
+      emulated.device.recall(1);
+      emulated.Run();
+
+      THEN("The routing is read after the recall") {
+        REQUIRE(emulated.emulator.ties == preset);
+        REQUIRE(emulated.inputOfOutput == preset);
+        REQUIRE(emulated.errors.empty());
+      }
+
+      THEN("The preset cache has the routing of the preset") {
+        emulated.device.tie_multiple(std::vector<unsigned int>(8, 1));
+        emulated.Run();
+        emulated.device.recall(1);
+        emulated.io_service.poll();
+        REQUIRE(emulated.inputOfOutput == preset);
+      }
+    }
+
+    WHEN("An input is tied to several outputs") {
+      emulated.device.tie_multiple({ 3, 3, 0, 4, 5, 6, 3, 8 });
+      emulated.Run();
+
+      THEN("The reverse index has the outputs of each input") {
+        const Device& device = emulated.device;
+        REQUIRE(device.get_outputs_of_input(3) == Device::OutputSet(0x43));
+        REQUIRE(device.count_outputs_of_input(3) == 3);
+        REQUIRE(device.get_outputs_of_input(0) == Device::OutputSet(0x04));
+        REQUIRE(device.count_outputs_of_input(1) == 0);
+        REQUIRE(device.count_outputs_of_input(2) == 0);
+        REQUIRE(device.count_outputs_of_input(8) == 1);
+        REQUIRE(device.count_outputs_of_input(9) == 0);
+      }
+    }
+  }
+}
+
+SCENARIO("Controlling a 128x128 frame", "[device]") {
+  GIVEN("A device connected to a Matrix 12800") {
+    EmulatedDevice emulated(nullptr, EmulatedLink(), 128);
+    std::vector<unsigned int> reversed(128);
+    for (unsigned int i = 0; i < 128; ++i)
+      reversed[i] = 128 - i;
+    emulated.emulator.presets[0] = reversed;
+
+    WHEN("A preset is recalled") {
+      emulated.device.recall(1);
+      emulated.Run();
+
+      THEN("The ties of all outputs are read") {
+        REQUIRE(emulated.connected);
+        REQUIRE(emulated.errors.empty());
+        REQUIRE(emulated.device.get_number_of_virtual_inputs() == 128);
+        REQUIRE(emulated.inputOfOutput == reversed);
+      }
+    }
+
+    WHEN("The last input is tied to the last output") {
+      emulated.device.tie(128, 120);
+      emulated.device.tie_multiple(std::vector<unsigned int>(128, 128));
+      emulated.Run();
+
+      THEN("The matrix and the callback have the ties") {
+        REQUIRE(emulated.emulator.ties ==
+                std::vector<unsigned int>(128, 128));
+        REQUIRE(emulated.inputOfOutput ==
+                std::vector<unsigned int>(128, 128));
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+
+    WHEN("The names of inputs 49 to 64 change") {
+      const DeviceStatistics& statistics = emulated.device.get_statistics();
+      const size_t requests = statistics.get_requests();
+      serialPortFakeInstance.receive("RECONFIG20\r\n");
+      emulated.Run();
+
+      THEN("Only their names are read") {
+        REQUIRE(statistics.get_requests() == requests + 16);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+
+    WHEN("A burst of notifications arrives while a tie is in progress") {
+      const DeviceStatistics& statistics = emulated.device.get_statistics();
+      const size_t requests = statistics.get_requests();
+      emulated.device.tie(1, 1);
+      serialPortFakeInstance.receive("RECONFIG20\r\nRECONFIG21\r\n"
+                                     "RECONFIG20\r\nRECONFIG21\r\n"
+                                     "RECONFIG20\r\n");
+      emulated.Run();
+
+      THEN("Each name is read once") {
+        REQUIRE(statistics.get_requests() == requests + 1 + 32);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+  }
+}
+
+SCENARIO("Validating requests against the model", "[device]") {
+  GIVEN("A device connected to a matrix of the smallest series") {
+    EmulatedDevice emulated;
+    const DeviceStatistics& statistics = emulated.device.get_statistics();
+    const size_t requests = statistics.get_requests();
+
+    WHEN("Ties, presets and names out of range are requested") {
+      emulated.device.tie(3, 9);
+      emulated.device.tie(9, 1);
+      emulated.device.tie_multiple({ 2, 9 });
+      emulated.device.store(33);
+      emulated.device.recall(0);
+      emulated.device.set_output_name(9, "Projector");
+      emulated.Run();
+
+      THEN("They fail without being sent") {
+        REQUIRE(emulated.failedTies == std::vector<uint16_t>{ 9, 1, 2 });
+        REQUIRE(emulated.errors.size() == 6);
+        REQUIRE(statistics.get_requests() == requests + 1);
+        REQUIRE(emulated.emulator.ties[0] == 2);
+      }
+    }
+
+    WHEN("A name longer than the matrix keeps is written") {
+      emulated.device.set_input_name(1, "Document Camera");
+      emulated.Run();
+
+      THEN("It is cut off") {
+        REQUIRE(emulated.emulator.inputNames[0] == "Document Cam");
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+  }
+}
+
+SCENARIO("Verifying written names", "[device][timing]") {
+  GIVEN("A connected device") {
+    EmulatedDevice emulated;
+    std::vector<std::string> names(8);
+    emulated.device.inputNameChanged = [&names](uint16_t input,
+                                                const std::string& name) {
+      names[input - 1] = name;
+    };
+    const DeviceStatistics& statistics = emulated.device.get_statistics();
+    const size_t requests = statistics.get_requests();
+    auto relabel = [&emulated]() {
+      for (uint16_t input = 1; input <= 8; ++input)
+        emulated.device.set_input_name(input, "CAM " + std::to_string(input));
+      emulated.Run();
+    };
+
+    WHEN("Every written name is verified") {
+      relabel();
+
+      THEN("Each name is read back") {
+        REQUIRE(statistics.get_requests() == requests + 16);
+        REQUIRE(names[7] == "CAM 8");
+      }
+    }
+
+    WHEN("Every 8th written name is verified") {
+      emulated.device.set_name_verification(
+        Device::NameVerification::Sampled);
+      relabel();
+
+      THEN("One name is read back") {
+        REQUIRE(statistics.get_requests() == requests + 9);
+        REQUIRE(names[7] == "CAM 8");
+      }
+    }
+
+    WHEN("The acknowledgements are trusted") {
+      emulated.device.set_name_verification(
+        Device::NameVerification::TrustAck);
+      relabel();
+
+      THEN("The written names are published without reading them") {
+        REQUIRE(statistics.get_requests() == requests + 8);
+        REQUIRE(emulated.emulator.inputNames[0] == "CAM 1");
+        REQUIRE(names[0] == "CAM 1");
+        REQUIRE(names[7] == "CAM 8");
+        REQUIRE(emulated.errors.empty());
+      }
+
+      AND_WHEN("The matrix changed a name behind the device's back") {
+        emulated.emulator.inputNames[2] = "OTHER";
+        emulated.RunFor(std::chrono::seconds(10));
+
+        THEN("The audit reads each name once") {
+          REQUIRE(statistics.get_requests() == requests + 16);
+          REQUIRE(names[2] == "OTHER");
+        }
+
+        THEN("The audit stops when all names were read") {
+          emulated.RunFor(std::chrono::seconds(10));
+          REQUIRE(statistics.get_requests() == requests + 16);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Overflowing the request queue", "[device]") {
+  GIVEN("A connected device") {
+    EmulatedDevice emulated;
+
+    WHEN("More ties are requested than the queue can hold") {
+      // One tie is sent right away, the queue holds 3 * 8 + 8 + 2 requests.
+      for (unsigned int i = 0; i < 40; ++i) {
+        emulated.device.tie(i % 8 + 1, i % 8 + 1);
+      }
+      emulated.Run();
+
+      THEN("The ties which did not fit are failed") {
+        REQUIRE(emulated.failedTies ==
+                std::vector<uint16_t>{ 4, 5, 6, 7, 8 });
+        REQUIRE(emulated.errors.size() == 5);
+      }
+
+      THEN("The queued ties are sent") {
+        REQUIRE(emulated.emulator.ties[2] == 3);
+      }
+
+      THEN("The dropped ties are counted") {
+        REQUIRE(emulated.device.get_statistics().get_dropped() == 5);
+        REQUIRE(emulated.device.get_statistics().get_queue_depth() == 0);
+      }
+    }
+  }
+}
+
+SCENARIO("Tying does not allocate", "[device][allocation]") {
+  GIVEN("A connected device") {
+    EmulatedDevice emulated;
+
+    WHEN("Ties are requested repeatedly") {
+      // Let the queues reach their steady state size.
+      for (unsigned int i = 0; i < 100; ++i) {
+        emulated.device.tie(i % 8 + 1, i % 3 + 1);
+        emulated.device.tie(i % 7 + 1, i % 5 + 1);
+        emulated.Run();
+      }
+
+      size_t allocations = 0;
+      for (unsigned int i = 0; i < 1000; ++i) {
+        // The first tie is sent right away, the second one is queued.
+        const size_t before = allocationCount();
+        emulated.device.tie(i % 8 + 1, i % 3 + 1);
+        emulated.device.tie(i % 7 + 1, i % 5 + 1);
+        allocations += allocationCount() - before;
+
+        emulated.Run();
+      }
+
+      THEN("No allocation was made") {
+        REQUIRE(allocations == 0);
+        REQUIRE(emulated.errors.empty());
+      }
+    }
+  }
+}
+
+SCENARIO("Tracing the communication", "[device][serialtrace]") {
+  GIVEN("A connected device recording into a trace") {
+    const char* const path = "device_test.trc";
+
+    WHEN("An input is tied to an output") {
+      {
+        SerialTrace trace(path);
+        REQUIRE(trace.open(1024));
+        EmulatedDevice emulated;
+        emulated.device.set_trace(&trace);
+
+        emulated.device.tie(3, 2);
+        emulated.Run();
+        emulated.device.set_trace(nullptr);
+      }
+      std::vector<SerialTrace::Event> events;
+      REQUIRE(SerialTrace::read(path, events));
+      std::remove(path);
+
+      THEN("The lifecycle of the request is recorded") {
+        using Kind = SerialTrace::Kind;
+        const std::vector<Kind> kinds{ Kind::Enqueued,  Kind::Promoted,
+                                       Kind::Sent,      Kind::FirstByte,
+                                       Kind::Received,  Kind::Completed };
+        REQUIRE(events.size() == kinds.size());
+        for (size_t i = 0; i < events.size(); ++i) {
+          REQUIRE(events[i].kind == kinds[i]);
+          REQUIRE(events[i].type == events[0].type);
+          REQUIRE(events[i].request == events[0].request);
+          REQUIRE(events[i].time >= events[0].time);
+        }
+        REQUIRE(events[0].data == "3*2!");
+        REQUIRE(events[2].data == "3*2!");
+        REQUIRE(events[4].data == "Out02 In03 All");
+        REQUIRE(events[5].data.empty());
+      }
+    }
+  }
+}
+
+SCENARIO("Response timeouts in virtual time", "[device][timing]") {
+  using std::chrono::milliseconds;
+
+  GIVEN("A connected device") {
+    EmulatedDevice emulated;
+
+    WHEN("The matrix does not answer a tie") {
+      serialPortFakeInstance.respond = [](const std::string&) {
+        return std::string();
+      };
+      emulated.device.tie(3, 2);
+      emulated.Run();
+
+      THEN("Nothing fails before the deadline") {
+        emulated.io_service.advance(milliseconds(900));
+        REQUIRE(emulated.errors.empty());
+        REQUIRE(emulated.device.get_statistics().get_timeouts() == 0);
+      }
+
+      THEN("The tie fails as soon as the deadline is checked") {
+        emulated.io_service.advance(milliseconds(1100));
+        REQUIRE(emulated.failedTies == std::vector<uint16_t>{ 2 });
+        REQUIRE(emulated.errors.size() == 1);
+        REQUIRE(emulated.device.get_statistics().get_timeouts() == 1);
+        REQUIRE(SteadyClock::now() == SteadyClock::time_point(
+                                        milliseconds(1100)));
+      }
+    }
+  }
+
+  GIVEN("A matrix which answers after a latency") {
+    EmulatedDevice emulated;
+    const milliseconds latency(20);
+
+    WHEN("A tie is requested every 100 ms for an hour") {
+      for (unsigned int i = 0; i < 36000; ++i) {
+        emulated.device.tie(i % 8 + 1, i / 8 % 8 + 1);
+        emulated.io_service.advance(latency);
+        emulated.Run();
+        emulated.io_service.advance(milliseconds(100) - latency);
+      }
+
+      THEN("Every tie arrived in time") {
+        const DeviceStatistics& statistics = emulated.device.get_statistics();
+        REQUIRE(emulated.errors.empty());
+        REQUIRE(statistics.get_timeouts() == 0);
+        REQUIRE(statistics.get_round_trip(0.5) >= latency);
+        REQUIRE(statistics.get_round_trip(0.5) <= latency * 5 / 4);
+        REQUIRE(SteadyClock::now() ==
+                SteadyClock::time_point(std::chrono::hours(1)));
+      }
+    }
+  }
+}
+
+SCENARIO("Negotiating the baud rate", "[device][baudrate]") {
+  EmulatedLink link;
+  link.negotiateBaudRate = true;
+
+  GIVEN("A device negotiating with a matrix at the same rate") {
+    EmulatedDevice emulated(nullptr, link);
+
+    THEN("Both switch to the fastest rate right away") {
+      REQUIRE(emulated.connected);
+      REQUIRE(emulated.errors.empty());
+      REQUIRE(emulated.device.get_baud_rate() == 115200);
+      REQUIRE(serialPortFakeInstance.baud_rate == 115200);
+      REQUIRE(emulated.emulator.baudRate == 115200);
+    }
+  }
+
+  GIVEN("A device negotiating with a matrix at another rate") {
+    link.matrixBaudRate = 38400;
+    EmulatedDevice emulated(nullptr, link);
+    REQUIRE_FALSE(emulated.connected);
+
+    WHEN("The probes at the other rates time out") {
+      emulated.RunFor(std::chrono::seconds(3));
+
+      THEN("The rate of the matrix is found and upgraded") {
+        REQUIRE(emulated.connected);
+        REQUIRE(emulated.errors.empty());
+        REQUIRE(emulated.device.get_baud_rate() == 115200);
+        REQUIRE(emulated.emulator.baudRate == 115200);
+      }
+    }
+  }
+
+  GIVEN("A device negotiating with a matrix which supports up to 38400 baud") {
+    link.matrixMaxBaudRate = 38400;
+    EmulatedDevice emulated(nullptr, link);
+
+    THEN("Both use the fastest rate the matrix supports") {
+      REQUIRE(emulated.connected);
+      REQUIRE(emulated.errors.empty());
+      REQUIRE(emulated.device.get_baud_rate() == 38400);
+      REQUIRE(emulated.emulator.baudRate == 38400);
+    }
+  }
+
+  GIVEN("A device which does not negotiate") {
+    link.negotiateBaudRate = false;
+    link.matrixBaudRate = 38400;
+    EmulatedDevice emulated(nullptr, link);
+    emulated.RunFor(std::chrono::milliseconds(1100));
+
+    THEN("The information request times out") {
+      REQUIRE_FALSE(emulated.connected);
+      REQUIRE(emulated.errors.size() == 1);
+      REQUIRE(emulated.device.get_baud_rate() == 9600);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#include <catch.hpp>
+
+#include <chrono>
+
+#include "devicestatistics.h"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+SCENARIO("collecting device statistics", "[devicestatistics]") {
+  DeviceStatistics statistics;
+
+  GIVEN("No communication") {
+    THEN("Everything is zero") {
+      REQUIRE(statistics.get_requests() == 0);
+      REQUIRE(statistics.get_responses() == 0);
+      REQUIRE(statistics.get_errors() == 0);
+      REQUIRE(statistics.get_timeouts() == 0);
+      REQUIRE(statistics.get_dropped() == 0);
+      REQUIRE(statistics.get_queue_depth() == 0);
+      REQUIRE_FALSE(statistics.get_in_flight());
+      REQUIRE(statistics.get_round_trip(0.5) == microseconds(0));
+    }
+  }
+
+  GIVEN("Requests of several types") {
+    statistics.count_request(1);
+    statistics.count_request(1);
+    statistics.count_request(3);
+    statistics.count_request(DeviceStatistics::max_request_types);
+
+    THEN("They are counted per type and in total") {
+      REQUIRE(statistics.get_requests(1) == 2);
+      REQUIRE(statistics.get_requests(3) == 1);
+      REQUIRE(statistics.get_requests() == 3);
+    }
+  }
+
+  GIVEN("Queues of several classes") {
+    statistics.set_queue_depth(0, 2);
+    statistics.set_queue_depth(2, 5);
+    statistics.set_queue_depth(0, 1);
+
+    THEN("The depths are summed up") {
+      REQUIRE(statistics.get_queue_depth(0) == 1);
+      REQUIRE(statistics.get_queue_depth(2) == 5);
+      REQUIRE(statistics.get_queue_depth() == 6);
+    }
+  }
+
+  GIVEN("Responses with different round trip times") {
+    for (int i = 0; i < 98; ++i)
+      statistics.count_response(milliseconds(10));
+    statistics.count_response(milliseconds(100));
+    statistics.count_response(milliseconds(1000));
+
+    THEN("The percentiles are within a quarter of the round trip time") {
+      REQUIRE(statistics.get_responses() == 100);
+
+      const auto median = statistics.get_round_trip(0.5);
+      REQUIRE(median >= milliseconds(10));
+      REQUIRE(median <= milliseconds(10) * 5 / 4);
+
+      const auto p99 = statistics.get_round_trip(0.99);
+      REQUIRE(p99 >= milliseconds(100));
+      REQUIRE(p99 <= milliseconds(100) * 5 / 4);
+
+      const auto maximum = statistics.get_round_trip(1.0);
+      REQUIRE(maximum >= milliseconds(1000));
+      REQUIRE(maximum <= milliseconds(1000) * 5 / 4);
+    }
+  }
+
+  GIVEN("A response faster than a microsecond") {
+    statistics.count_response(std::chrono::nanoseconds(300));
+
+    THEN("It is in the lowest bucket") {
+      REQUIRE(statistics.get_round_trip(1.0) == microseconds(0));
+    }
+  }
+}
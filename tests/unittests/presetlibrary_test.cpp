@@ -0,0 +1,72 @@
+#include <catch.hpp>
+
+#include <cstdio>
+
+#include "presetlibrary.h"
+
+SCENARIO("host-side presets", "[presetlibrary]") {
+  GIVEN("An empty library") {
+    PresetLibrary library("presetlibrary_test.bin");
+
+    THEN("No preset is found") { REQUIRE(library.Find(1) == nullptr); }
+
+    WHEN("storing presets") {
+      library.Store(1, { 1, 2, 3 });
+      library.Store(1000, { 0, 4, 4 });
+
+      THEN("They can be found") {
+        REQUIRE(library.Find(1) != nullptr);
+        REQUIRE(*library.Find(1) == std::vector<unsigned int>{ 1, 2, 3 });
+        REQUIRE(library.Find(1000) != nullptr);
+        REQUIRE(*library.Find(1000) == std::vector<unsigned int>{ 0, 4, 4 });
+      }
+
+      THEN("They are serialized compactly") {
+        const std::vector<char> data = library.Serialize();
+        REQUIRE(data.size() == 4 + 1 + 4 + 2 * (4 + 2 + 3));
+      }
+
+      WHEN("deserializing into another library") {
+        PresetLibrary other("presetlibrary_test.bin");
+        REQUIRE(other.Deserialize(library.Serialize()));
+
+        THEN("It contains the same presets") {
+          REQUIRE(other.Find(1) != nullptr);
+          REQUIRE(*other.Find(1) == std::vector<unsigned int>{ 1, 2, 3 });
+          REQUIRE(other.Find(1000) != nullptr);
+          REQUIRE(*other.Find(1000) == std::vector<unsigned int>{ 0, 4, 4 });
+        }
+      }
+
+      WHEN("saving and loading the file") {
+        REQUIRE(library.Save());
+        PresetLibrary other("presetlibrary_test.bin");
+        REQUIRE(other.Load());
+        std::remove("presetlibrary_test.bin");
+
+        THEN("It contains the same presets") {
+          REQUIRE(other.Find(1) != nullptr);
+          REQUIRE(*other.Find(1) == std::vector<unsigned int>{ 1, 2, 3 });
+        }
+      }
+    }
+  }
+
+  GIVEN("Corrupt data") {
+    PresetLibrary library("presetlibrary_test.bin");
+    library.Store(2, { 5 });
+
+    const std::vector<char> data{ 'E', 'X', 'P', 'L', 1, 1, 0, 0, 0, 7 };
+
+    THEN("Deserializing fails and keeps the presets") {
+      REQUIRE_FALSE(library.Deserialize(data));
+      REQUIRE(library.Find(2) != nullptr);
+    }
+  }
+
+  GIVEN("A library without a file") {
+    PresetLibrary library("presetlibrary_test_missing.bin");
+
+    THEN("Loading succeeds") { REQUIRE(library.Load()); }
+  }
+}
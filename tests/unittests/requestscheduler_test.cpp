@@ -0,0 +1,162 @@
+#include <catch.hpp>
+
+#include <chrono>
+#include <string>
+
+#include "requestscheduler.h"
+
+namespace {
+struct TestRequest
+{
+  std::string request;
+  int id;
+};
+
+using Scheduler = RequestScheduler<TestRequest>;
+using Clock = Scheduler::Clock;
+} // namespace
+
+SCENARIO("scheduling requests", "[requestscheduler]") {
+  Scheduler scheduler(128);
+  const Clock::time_point start;
+
+  GIVEN("No requests") {
+    THEN("Nothing is scheduled") {
+      TestRequest request;
+      REQUIRE(scheduler.empty());
+      REQUIRE_FALSE(scheduler.pop(request, start));
+    }
+  }
+
+  GIVEN("Requests of one class") {
+    scheduler.push(RequestClass::Monitoring, { "a", 1 }, start);
+    scheduler.push(RequestClass::Monitoring, { "b", 2 }, start);
+    scheduler.push(RequestClass::Monitoring, { "c", 3 }, start);
+
+    THEN("They are scheduled in order") {
+      TestRequest request;
+      RequestClass request_class;
+      for (int id = 1; id <= 3; ++id) {
+        REQUIRE(scheduler.pop(request, start, &request_class));
+        REQUIRE(request.id == id);
+        REQUIRE(request_class == RequestClass::Monitoring);
+      }
+      REQUIRE(scheduler.empty());
+    }
+  }
+
+  GIVEN("A name read queued before a tie") {
+    scheduler.push(RequestClass::Names, { "\x1BNO1\r", 1 }, start);
+    scheduler.push(RequestClass::Control, { "1*1!", 2 }, start);
+
+    THEN("The tie is scheduled first") {
+      TestRequest request;
+      REQUIRE(scheduler.pop(request, start));
+      REQUIRE(request.id == 2);
+      REQUIRE(scheduler.pop(request, start));
+      REQUIRE(request.id == 1);
+    }
+  }
+
+  GIVEN("A steady stream of ties and many name reads") {
+    for (int id = 0; id < 100; ++id) {
+      scheduler.push(RequestClass::Names, { "\x1BNO1\r", id }, start);
+    }
+
+    THEN("Name reads are still scheduled") {
+      TestRequest request;
+      RequestClass request_class;
+      int names = 0;
+      for (int i = 0; i < 1000; ++i) {
+        scheduler.push(RequestClass::Control, { "1*1!", -1 }, start);
+        REQUIRE(scheduler.pop(request, start, &request_class));
+        if (request_class == RequestClass::Names)
+          ++names;
+      }
+      REQUIRE(names > 0);
+    }
+  }
+
+  GIVEN("A name read waiting longer than allowed") {
+    scheduler.set_policy(RequestClass::Names,
+                         { 1, std::chrono::milliseconds(100) });
+    scheduler.push(RequestClass::Names, { "\x1BNO1\r", 1 }, start);
+    scheduler.push(RequestClass::Control, { "1*1!", 2 }, start);
+
+    THEN("It is scheduled before the tie") {
+      TestRequest request;
+      Clock::duration waited;
+      REQUIRE(scheduler.pop(
+        request, start + std::chrono::milliseconds(200), nullptr, &waited));
+      REQUIRE(request.id == 1);
+      REQUIRE(waited == std::chrono::milliseconds(200));
+    }
+  }
+
+  GIVEN("Requests of all classes") {
+    scheduler.push(RequestClass::Control, { "1*1!", 1 }, start);
+    scheduler.push(RequestClass::Monitoring, { "I", 2 }, start);
+    scheduler.push(RequestClass::Names, { "\x1BNO1\r", 3 }, start);
+
+    WHEN("clearing one class") {
+      scheduler.clear(RequestClass::Monitoring);
+
+      THEN("The other classes are kept") {
+        REQUIRE(scheduler.size(RequestClass::Control) == 1);
+        REQUIRE(scheduler.size(RequestClass::Monitoring) == 0);
+        REQUIRE(scheduler.size(RequestClass::Names) == 1);
+      }
+    }
+
+    WHEN("clearing all classes") {
+      scheduler.clear();
+
+      THEN("No request is left") { REQUIRE(scheduler.empty()); }
+    }
+  }
+
+  GIVEN("A tie which used up the quantum of its class") {
+    scheduler.set_policy(RequestClass::Control,
+                         { 4, std::chrono::milliseconds(500) });
+    scheduler.push(RequestClass::Control, { "1*1!", 1 }, start);
+    TestRequest request;
+    REQUIRE(scheduler.pop(request, start));
+
+    WHEN("clearing all classes and queueing a read before a recall") {
+      scheduler.clear();
+      scheduler.push(RequestClass::Monitoring, { "0*1*00VA", 2 }, start);
+      scheduler.push(RequestClass::Control, { "1.", 3 }, start);
+
+      THEN("The recall is scheduled first") {
+        REQUIRE(scheduler.pop(request, start));
+        REQUIRE(request.id == 3);
+      }
+    }
+  }
+
+  GIVEN("A full queue") {
+    scheduler.set_capacity(RequestClass::Names, 256);
+    for (int id = 0; id < 256; ++id) {
+      REQUIRE(scheduler.push(RequestClass::Names, { "\x1BNO1\r", id }, start));
+    }
+
+    THEN("Further requests of the class are rejected") {
+      REQUIRE(scheduler.capacity(RequestClass::Names) == 256);
+      REQUIRE_FALSE(
+        scheduler.push(RequestClass::Names, { "\x1BNO2\r", 256 }, start));
+      REQUIRE(scheduler.size(RequestClass::Names) == 256);
+    }
+
+    THEN("Other classes still accept requests") {
+      REQUIRE(scheduler.push(RequestClass::Control, { "1*1!", 256 }, start));
+    }
+
+    THEN("The queued requests keep their order") {
+      TestRequest request;
+      for (int id = 0; id < 256; ++id) {
+        REQUIRE(scheduler.pop(request, start));
+        REQUIRE(request.id == id);
+      }
+    }
+  }
+}
@@ -0,0 +1,139 @@
+#include <catch.hpp>
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "matrixemulator.h"
+#include "serialport_fake.h"
+#include "serialportdiscovery.h"
+
+SCENARIO("Discovering serial ports", "[serialportdiscovery]") {
+  GIVEN("Three ports with a matrix behind the second") {
+    std::atomic<int> probing{ 0 };
+    std::atomic<int> maxProbing{ 0 };
+    std::atomic<int> probes{ 0 };
+    std::atomic<unsigned int> baudRate{ 0 };
+    SerialPortDiscovery discovery(
+      []() { return std::vector<std::string>{ "A", "B", "C" }; },
+      [&](SerialPortDiscovery::Port& port, unsigned int rate) {
+        ++probes;
+        baudRate = rate;
+        const int now = ++probing;
+        int max = maxProbing;
+        while (now > max && !maxProbing.compare_exchange_weak(max, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        --probing;
+
+        if (port.name != "B")
+          return false;
+        port.inputs = 12;
+        port.outputs = 8;
+        return true;
+      });
+
+    THEN("Nothing is known before the first discovery") {
+      REQUIRE(discovery.GetPorts().empty());
+    }
+
+    WHEN("The ports are discovered with probing") {
+      std::atomic<bool> done{ false };
+      REQUIRE(discovery.Start(true, 38400, [&done]() { done = true; }));
+      REQUIRE_FALSE(discovery.Start(true));
+      discovery.Wait();
+
+      THEN("All ports were probed at the same time") {
+        REQUIRE(probes == 3);
+        REQUIRE(maxProbing == 3);
+      }
+
+      THEN("The ports were probed with the given baud rate") {
+        REQUIRE(baudRate == 38400);
+      }
+
+      THEN("The port with the matrix comes first") {
+        const std::vector<SerialPortDiscovery::Port> ports =
+          discovery.GetPorts();
+        REQUIRE(ports.size() == 3);
+        REQUIRE(ports[0].name == "B");
+        REQUIRE(ports[0].matrix);
+        REQUIRE(ports[0].inputs == 12);
+        REQUIRE(ports[0].outputs == 8);
+        REQUIRE(ports[1].name == "A");
+        REQUIRE_FALSE(ports[1].matrix);
+        REQUIRE(ports[2].name == "C");
+      }
+
+      THEN("The caller was told") { REQUIRE(done); }
+
+      AND_WHEN("The ports are listed again without probing") {
+        REQUIRE(discovery.Start(false));
+        discovery.Wait();
+
+        THEN("The matrix found before is kept") {
+          const std::vector<SerialPortDiscovery::Port> ports =
+            discovery.GetPorts();
+          REQUIRE(probes == 3);
+          REQUIRE(ports.size() == 3);
+          REQUIRE(ports[0].name == "B");
+          REQUIRE(ports[0].matrix);
+          REQUIRE(ports[0].inputs == 12);
+        }
+      }
+    }
+
+    WHEN("The ports are discovered without probing") {
+      discovery.Start(false);
+      discovery.Wait();
+
+      THEN("The ports are listed in order without probes") {
+        const std::vector<SerialPortDiscovery::Port> ports =
+          discovery.GetPorts();
+        REQUIRE(probes == 0);
+        REQUIRE(ports.size() == 3);
+        REQUIRE(ports[1].name == "B");
+        REQUIRE_FALSE(ports[1].matrix);
+      }
+    }
+  }
+}
+
+SCENARIO("Probing a serial port", "[serialportdiscovery]") {
+  MatrixEmulator emulator(12, 8);
+  serialPortFakeInstance.reset();
+  SerialPortDiscovery::Port port{ "EMULATOR" };
+
+  GIVEN("A matrix behind the port") {
+    serialPortFakeInstance.respond = [&emulator](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    WHEN("The port is probed") {
+      std::future<bool> probe =
+        std::async(std::launch::async, [&port]() {
+          return ProbeSerialPort(port, 19200);
+        });
+      while (probe.wait_for(std::chrono::milliseconds(1)) !=
+             std::future_status::ready) {
+        serialPortFakeInstance.pump();
+      }
+
+      THEN("The dimensions of the matrix are known") {
+        REQUIRE(probe.get());
+        REQUIRE(port.inputs == 12);
+        REQUIRE(port.outputs == 8);
+        REQUIRE(serialPortFakeInstance.baud_rate == 19200);
+      }
+    }
+  }
+
+  GIVEN("Nothing behind the port") {
+    WHEN("The port is probed") {
+      THEN("The probe fails after the timeout") {
+        REQUIRE_FALSE(ProbeSerialPort(port));
+        REQUIRE(serialPortFakeInstance.written == "I");
+      }
+    }
+  }
+}
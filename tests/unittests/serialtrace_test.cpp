@@ -0,0 +1,101 @@
+#include <catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "serialtrace.h"
+
+namespace {
+const char* const path = "serialtrace_test.trc";
+
+void record(SerialTrace& trace,
+            SerialTrace::Kind kind,
+            const std::string& data,
+            SerialTrace::Clock::time_point time)
+{
+  trace.record(kind, 7, 42, data.data(), data.size(), time);
+}
+} // namespace
+
+SCENARIO("recording serial traffic", "[serialtrace]") {
+  std::vector<SerialTrace::Event> events;
+
+  GIVEN("A trace with a few events") {
+    {
+      SerialTrace trace(path);
+      REQUIRE(trace.open(64));
+      REQUIRE(trace.is_open());
+
+      const auto now = SerialTrace::Clock::now();
+      record(trace, SerialTrace::Kind::Sent, "3*2!", now);
+      record(trace,
+             SerialTrace::Kind::Received,
+             "Out2 In3 All",
+             now + std::chrono::milliseconds(5));
+      record(trace,
+             SerialTrace::Kind::Received,
+             std::string(100, 'x'),
+             now + std::chrono::milliseconds(6));
+    }
+
+    WHEN("reading the file") {
+      REQUIRE(SerialTrace::read(path, events));
+      std::remove(path);
+
+      THEN("All events are read in order") {
+        REQUIRE(events.size() == 3);
+        REQUIRE(events[0].kind == SerialTrace::Kind::Sent);
+        REQUIRE(events[0].type == 7);
+        REQUIRE(events[0].request == 42);
+        REQUIRE(events[0].data == "3*2!");
+        REQUIRE(events[1].kind == SerialTrace::Kind::Received);
+        REQUIRE(events[1].data == "Out2 In3 All");
+        REQUIRE(events[1].time - events[0].time == 5000000);
+      }
+
+      THEN("Events longer than a slot are complete") {
+        REQUIRE(events[2].data == std::string(100, 'x'));
+      }
+    }
+  }
+
+  GIVEN("A trace with more events than fit into the ring") {
+    {
+      SerialTrace trace(path);
+      REQUIRE(trace.open(64));
+
+      const auto now = SerialTrace::Clock::now();
+      for (int i = 0; i < 200; ++i)
+        record(trace,
+               SerialTrace::Kind::Sent,
+               std::to_string(i),
+               now + std::chrono::microseconds(i));
+    }
+
+    WHEN("reading the file") {
+      REQUIRE(SerialTrace::read(path, events));
+      std::remove(path);
+
+      THEN("The newest events are kept") {
+        REQUIRE(events.size() == 64);
+        REQUIRE(events.front().data == "136");
+        REQUIRE(events.back().data == "199");
+      }
+    }
+  }
+
+  GIVEN("A file which is no trace") {
+    {
+      FILE* file = std::fopen(path, "wb");
+      std::fputs("no trace", file);
+      std::fclose(file);
+    }
+
+    THEN("Reading it fails") {
+      REQUIRE_FALSE(SerialTrace::read(path, events));
+      std::remove(path);
+    }
+  }
+}
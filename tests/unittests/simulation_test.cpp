@@ -0,0 +1,317 @@
+#include <catch.hpp>
+
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include "allocationcounter.h"
+#include "matrixemulator.h"
+#include "serialport_fake.h"
+#include "simulation.h"
+
+namespace {
+//! Pins of an emulated 8x8 matrix with name pins.
+struct Pins
+{
+  static const size_t outputs = 8;
+  static const size_t inputNames = 2 + outputs;
+  static const size_t outputNames = 3 + outputs;
+
+  std::array<double, 100> PInput{};
+  std::array<double, 100> POutput{};
+  std::array<std::array<char, 1000>, 100> PStringsMemory{};
+  std::array<char*, 100> PStrings;
+
+  Pins()
+  {
+    for (size_t i = 0; i < PStringsMemory.size(); ++i)
+      PStrings[i] = PStringsMemory[i].data();
+  }
+};
+}
+
+SCENARIO("Simulation steps do not allocate", "[simulation][allocation]") {
+  GIVEN("A simulation connected to an emulated matrix") {
+    MatrixEmulator emulator(8, 8);
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [&emulator](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = 8;
+    configuration.outputs = 8;
+    configuration.includeInputNames = true;
+    configuration.includeOutputNames = true;
+
+    auto pins = std::make_unique<Pins>();
+    strcpy(pins->PStrings[Pins::inputNames], "CAM 1;CAM 2;CAM 3");
+    strcpy(pins->PStrings[Pins::outputNames], "MON 1;MON 2");
+
+    Simulation simulation(configuration);
+    serialPortFakeInstance.pumpUntilIdle();
+
+    auto step = [&]() {
+      const size_t before = allocationCount();
+      simulation.Calculate(
+        pins->PInput.data(), pins->POutput.data(), pins->PStrings.data());
+      const size_t allocations = allocationCount() - before;
+      serialPortFakeInstance.pumpUntilIdle();
+      return allocations;
+    };
+
+    // Send the names and let the device cache its presets.
+    for (int i = 0; i < 10; ++i)
+      step();
+
+    WHEN("Nothing changes") {
+      size_t allocations = 0;
+      for (int i = 0; i < 5000; ++i)
+        allocations += step();
+
+      THEN("No allocation was made") { REQUIRE(allocations == 0); }
+    }
+
+    WHEN("OUT pins change every step") {
+      auto change = [&](unsigned int i) {
+        pins->PInput[2 + i % Pins::outputs] = (i / Pins::outputs) % 8 + 1;
+      };
+
+      for (unsigned int i = 0; i < 100; ++i) {
+        change(i);
+        step();
+      }
+
+      size_t allocations = 0;
+      for (unsigned int i = 0; i < 5000; ++i) {
+        change(i);
+        allocations += step();
+      }
+
+      THEN("No allocation was made") {
+        REQUIRE(allocations == 0);
+        REQUIRE(pins->POutput[1] == 0.0);
+      }
+
+      THEN("The matrix has the last ties") {
+        for (unsigned int i = 0; i < Pins::outputs; ++i)
+          REQUIRE(emulator.ties[i] == pins->PInput[2 + i]);
+      }
+    }
+  }
+}
+
+SCENARIO("Reading only the names of name pins", "[simulation]") {
+  GIVEN("An emulated matrix counting the reads of names") {
+    MatrixEmulator emulator(8, 8);
+    std::string nameReads;
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [&](const std::string& request) {
+      if (request.compare(0, 2, "\x1BN") == 0)
+        nameReads += request[2];
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = 8;
+    configuration.outputs = 8;
+
+    WHEN("No name pins are configured") {
+      Simulation simulation(configuration);
+      serialPortFakeInstance.pumpUntilIdle();
+
+      THEN("No name is read") { REQUIRE(nameReads.empty()); }
+    }
+
+    WHEN("Only the output names are shown") {
+      configuration.includeOutputNames = true;
+      Simulation simulation(configuration);
+      serialPortFakeInstance.pumpUntilIdle();
+
+      THEN("Only they are read") { REQUIRE(nameReads == "OOOOOOOO"); }
+    }
+
+    WHEN("The pins show fewer inputs than the matrix has") {
+      configuration.inputs = 4;
+      configuration.includeInputNames = true;
+      Simulation simulation(configuration);
+      serialPortFakeInstance.pumpUntilIdle();
+
+      THEN("Only their names are read") { REQUIRE(nameReads == "IIII"); }
+    }
+  }
+}
+
+SCENARIO("Compact OUT pins", "[simulation]") {
+  GIVEN("A simulation with five outputs per OUT pin") {
+    MatrixEmulator emulator(8, 8);
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [&emulator](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = 8;
+    configuration.outputs = 8;
+    configuration.compactPins = true;
+
+    auto pins = std::make_unique<Pins>();
+    Simulation simulation(configuration);
+    serialPortFakeInstance.pumpUntilIdle();
+
+    auto step = [&]() {
+      simulation.Calculate(
+        pins->PInput.data(), pins->POutput.data(), pins->PStrings.data());
+      serialPortFakeInstance.pumpUntilIdle();
+    };
+    step();
+
+    WHEN("The OUT pins hold packed inputs") {
+      // Outputs 1 and 2 on the first pin, output 7 on the second one.
+      pins->PInput[2] = 2003;
+      pins->PInput[3] = 7000;
+      step();
+      step();
+
+      THEN("The outputs are tied") {
+        REQUIRE(emulator.ties ==
+                std::vector<unsigned int>{ 3, 2, 0, 0, 0, 0, 7, 0 });
+      }
+
+      THEN("The OUT pins show the packed ties") {
+        REQUIRE(pins->POutput[3] == 2003);
+        REQUIRE(pins->POutput[4] == 7000);
+        REQUIRE(pins->POutput[1] == 0.0);
+      }
+    }
+  }
+}
+
+SCENARIO("$MAP pins", "[simulation]") {
+  GIVEN("A simulation routing with $MAP strings") {
+    MatrixEmulator emulator(8, 8);
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [&emulator](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = 8;
+    configuration.outputs = 8;
+    configuration.mapPins = true;
+
+    auto pins = std::make_unique<Pins>();
+    Simulation simulation(configuration);
+    serialPortFakeInstance.pumpUntilIdle();
+
+    auto step = [&]() {
+      const size_t before = allocationCount();
+      simulation.Calculate(
+        pins->PInput.data(), pins->POutput.data(), pins->PStrings.data());
+      const size_t allocations = allocationCount() - before;
+      serialPortFakeInstance.pumpUntilIdle();
+      return allocations;
+    };
+    step();
+
+    WHEN("The $MAP input pin holds the first outputs") {
+      strcpy(pins->PStrings[2], "0302");
+      step();
+      step();
+
+      THEN("Only they are tied") {
+        REQUIRE(emulator.ties ==
+                std::vector<unsigned int>{ 3, 2, 0, 0, 0, 0, 0, 0 });
+      }
+
+      THEN("The $MAP output pin shows the whole routing") {
+        REQUIRE(std::string(pins->PStrings[3]) == "0302000000000000");
+        REQUIRE(pins->POutput[1] == 0.0);
+      }
+
+      AND_WHEN("An entry of the $MAP input pin changes") {
+        emulator.ties[0] = 5;
+        strcpy(pins->PStrings[2], "0308");
+        step();
+        step();
+
+        THEN("Only its output is tied") {
+          REQUIRE(emulator.ties ==
+                  std::vector<unsigned int>{ 5, 8, 0, 0, 0, 0, 0, 0 });
+        }
+      }
+    }
+
+    WHEN("The $MAP input pin changes every step") {
+      const std::array<const char*, 2> maps{ { "0102030405060708",
+                                               "0807060504030201" } };
+      for (unsigned int i = 0; i < 10; ++i) {
+        strcpy(pins->PStrings[2], maps[i % 2]);
+        step();
+      }
+
+      size_t allocations = 0;
+      for (unsigned int i = 0; i < 1000; ++i) {
+        strcpy(pins->PStrings[2], maps[i % 2]);
+        allocations += step();
+      }
+      // The confirmed ties are shown by the next step.
+      step();
+
+      THEN("No allocation was made") {
+        REQUIRE(allocations == 0);
+        REQUIRE(std::string(pins->PStrings[3]) == maps[1]);
+      }
+    }
+  }
+}
+
+SCENARIO("Optimistic ties dropped by a store", "[simulation]") {
+  GIVEN("A simulation showing ties before their confirmation") {
+    MatrixEmulator emulator(8, 8);
+    serialPortFakeInstance.reset();
+    serialPortFakeInstance.respond = [&emulator](const std::string& request) {
+      return emulator.Respond(request);
+    };
+
+    Configuration configuration;
+    configuration.comPort = "EMULATOR";
+    configuration.inputs = 8;
+    configuration.outputs = 8;
+    configuration.optimisticTies = true;
+    const size_t pendingPin = 3 + configuration.outputs;
+
+    auto pins = std::make_unique<Pins>();
+    Simulation simulation(configuration);
+    serialPortFakeInstance.pumpUntilIdle();
+    auto calculate = [&]() {
+      simulation.Calculate(
+        pins->PInput.data(), pins->POutput.data(), pins->PStrings.data());
+    };
+    calculate();
+    serialPortFakeInstance.pumpUntilIdle();
+
+    WHEN("Two ties are followed by a store before the matrix answered") {
+      // The first tie is sent, the second one waits in the queue.
+      pins->PInput[2] = 3;
+      pins->PInput[3] = 4;
+      calculate();
+      pins->PInput[0] = 1;
+      calculate();
+      serialPortFakeInstance.pumpUntilIdle();
+      calculate();
+
+      THEN("The dropped tie is no longer pending") {
+        REQUIRE(pins->POutput[pendingPin] == 0.0);
+        REQUIRE(pins->POutput[3] == 3.0);
+        REQUIRE(pins->POutput[4] == 0.0);
+        REQUIRE(emulator.ties[1] == 0);
+        REQUIRE(emulator.presets[0][0] == 3);
+      }
+    }
+  }
+}
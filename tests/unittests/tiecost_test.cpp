@@ -0,0 +1,116 @@
+#include <catch.hpp>
+
+#include <vector>
+
+#include "tiecost.h"
+
+namespace {
+using Routing = std::vector<unsigned int>;
+
+//! Input n on output n.
+Routing Diagonal(unsigned int outputs)
+{
+  Routing routing(outputs);
+  for (unsigned int i = 0; i < outputs; ++i)
+    routing[i] = i + 1;
+  return routing;
+}
+} // namespace
+
+SCENARIO("Encoding scene transitions", "[tiecost]") {
+  GIVEN("An 8x8 matrix with the diagonal routing") {
+    const Routing current = Diagonal(8);
+
+    WHEN("One input is tied to all outputs") {
+      const Routing scene(8, 3);
+
+      THEN("Tying all outputs at once is shortest") {
+        // Seven ties of four bytes in a single quick multiple tie.
+        REQUIRE(TieCost::ties(scene, current) == 4 + 7 * 4);
+        REQUIRE(TieCost::tie_all(3) == 3);
+        REQUIRE(TieCost::broadcast_input(scene, current) == 3u);
+      }
+    }
+
+    WHEN("All outputs are untied") {
+      const Routing scene(8, 0);
+
+      THEN("Input 0 is tied to all outputs") {
+        REQUIRE(TieCost::broadcast_input(scene, current) == 0u);
+      }
+    }
+
+    WHEN("Two outputs are swapped") {
+      const Routing scene{ 2, 1, 3, 4, 5, 6, 7, 8 };
+
+      THEN("A quick multiple tie holds both ties") {
+        REQUIRE(TieCost::ties(scene, current) == 4 + 2 * 4);
+        REQUIRE_FALSE(TieCost::broadcast_input(scene, current));
+      }
+    }
+
+    WHEN("Nothing changes") {
+      THEN("Nothing is sent") {
+        REQUIRE(TieCost::ties(current, current) == 0);
+        REQUIRE_FALSE(TieCost::broadcast_input(current, current));
+      }
+    }
+
+    WHEN("Only the first outputs are requested") {
+      const Routing scene(4, 3);
+
+      THEN("The other outputs are not tied to the input") {
+        REQUIRE(TieCost::ties(scene, current) == 4 + 3 * 4);
+        REQUIRE_FALSE(TieCost::broadcast_input(scene, current));
+      }
+    }
+  }
+
+  GIVEN("An 8x8 matrix with input 2 on all outputs but the last") {
+    const Routing current{ 2, 2, 2, 2, 2, 2, 2, 1 };
+
+    WHEN("The last output shows input 2, too") {
+      const Routing scene(8, 2);
+
+      THEN("Tying all outputs is still shorter than the single tie") {
+        REQUIRE(TieCost::ties(scene, current) == 8);
+        REQUIRE(TieCost::broadcast_input(scene, current) == 2u);
+      }
+    }
+
+    WHEN("The diagonal routing is restored") {
+      THEN("Each changed output is tied, as there is no short form") {
+        REQUIRE(TieCost::ties(Diagonal(8), current) == 4 + 7 * 4);
+        REQUIRE_FALSE(TieCost::broadcast_input(Diagonal(8), current));
+      }
+    }
+  }
+
+  GIVEN("A 128x128 matrix without any ties") {
+    const Routing current(128, 0);
+
+    WHEN("Input 100 is tied to all outputs") {
+      const Routing scene(128, 100);
+
+      THEN("The ties take several quick multiple ties") {
+        // "100*n!" for every output, without the overhead of the requests.
+        const size_t ties = 128 * 5 + 9 * 1 + 90 * 2 + 29 * 3;
+        REQUIRE(TieCost::ties(scene, current) ==
+                ties + 8 * TieCost::quick_tie_overhead);
+      }
+
+      THEN("A single tie to all outputs replaces them") {
+        REQUIRE(TieCost::tie_all(100) == 5);
+        REQUIRE(TieCost::broadcast_input(scene, current) == 100u);
+      }
+    }
+
+    WHEN("The diagonal routing is recalled") {
+      THEN("Every output is tied") {
+        REQUIRE(TieCost::ties(Diagonal(128), current) >
+                2 * (9 * 1 + 90 * 2 + 29 * 3) + 128 * 2);
+        REQUIRE_FALSE(TieCost::broadcast_input(Diagonal(128), current));
+      }
+    }
+  }
+}
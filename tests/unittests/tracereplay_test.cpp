@@ -0,0 +1,79 @@
+#include <catch.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include "emulateddevice.h"
+#include "serialtrace.h"
+#include "tracereplay.h"
+
+namespace {
+const char* const path = "tracereplay_test.trc";
+}
+
+SCENARIO("replaying a recorded session", "[tracereplay]") {
+  GIVEN("A trace of a session with an emulated matrix") {
+    {
+      SerialTrace trace(path);
+      REQUIRE(trace.open(4096));
+      EmulatedDevice emulated(&trace);
+
+      emulated.device.tie(3, 2);
+      emulated.Run();
+      emulated.device.tie_multiple({ 8, 7, 6, 5, 4, 3, 2, 1 });
+      emulated.Run();
+      emulated.device.set_output_name(1, "Beamer");
+      emulated.Run();
+      emulated.device.store(2);
+      emulated.Run();
+      // The second tie waits in the queue for the response to the first one.
+      emulated.device.tie(1, 1);
+      emulated.device.tie(2, 2);
+      emulated.Run();
+      emulated.device.recall(2);
+      emulated.Run();
+
+      emulated.device.set_trace(nullptr);
+    }
+    std::vector<SerialTrace::Event> events;
+    REQUIRE(SerialTrace::read(path, events));
+    std::remove(path);
+
+    WHEN("replaying it") {
+      TraceReplay replay(events);
+      const TraceReplay::Report report = replay.Run();
+
+      THEN("The same requests are sent") {
+        CAPTURE(report.firstMismatch);
+        REQUIRE(report.mismatches == 0);
+        REQUIRE(report.requests > 0);
+        REQUIRE(report.lines >= report.requests);
+      }
+
+      THEN("The processing is measured") {
+        REQUIRE(report.processing.count() > 0);
+        REQUIRE(report.maxProcessing <= report.processing);
+        REQUIRE(report.maxQueueDepth >= 1);
+        REQUIRE(report.dropped == 0);
+      }
+    }
+
+    WHEN("replaying it with a different recorded request") {
+      for (SerialTrace::Event& event : events) {
+        if (event.kind == SerialTrace::Kind::Sent &&
+            event.data == "0*1*00VA") {
+          event.data = "0*9*00VA";
+          break;
+        }
+      }
+      TraceReplay replay(events);
+      const TraceReplay::Report report = replay.Run();
+
+      THEN("The mismatch is reported") {
+        REQUIRE(report.mismatches == 1);
+        REQUIRE(report.firstMismatch ==
+                "Expected request 0*9*00VA but got 0*1*00VA.");
+      }
+    }
+  }
+}